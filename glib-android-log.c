@@ -0,0 +1,1221 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * Logging. g_android_init() installs _g_android_log_handler() as the default
+ * GLib log handler, which writes the messages to liblog.
+ *
+ * In asynchronous mode, see g_android_log_set_async(), the messages are
+ * copied into a ring of fixed size records and written by a dedicated thread
+ * instead, so the logging threads don't pay for the round trip to logd. The
+ * ring is a bounded multi-producer queue: each record carries a sequence
+ * number telling whether it is free for the position being enqueued or
+ * holds the one being dequeued, positions are claimed with a compare and
+ * exchange. The writer thread sleeps when the ring is empty and the loggers
+ * only take a lock to wake it up, or to wait for room with the
+ * %G_ANDROID_LOG_OVERFLOW_BLOCK policy.
+ *
+ * Messages that don't fit in a record and fatal messages are written
+ * synchronously, once the ring has been flushed to keep the order of the
+ * messages of a thread.
+ *
+ * Each domain can have a threshold, see g_android_log_set_threshold(), kept
+ * as the mask of the levels it lets through. The messages below it are
+ * dropped first thing by the handler, and g_android_log_is_enabled() lets
+ * callers skip the formatting GLib does before calling the handler. Without
+ * any per-domain threshold, the default mask is read without any lock.
+ *
+ * Once a message is let through by the thresholds, two optional filters can
+ * drop it. Identical consecutive messages can be collapsed into a "last
+ * message repeated N times" line, see g_android_log_set_collapse_repeats(),
+ * comparing each message with a copy of the previous one. Domains can be
+ * given a token bucket, see g_android_log_set_rate_limit(), split into a few
+ * buckets per call site for the messages of g_log_structured() that carry
+ * their location. Both filters share a mutex, only taken once one of them has
+ * been configured.
+ *
+ * A trace file can replace the Android log, see glib-android-trace.c.
+ *
+ * With GLib 2.50 or later, g_android_log_writer() gets the messages of
+ * g_log_structured() and formats their fields on the stack, so a message
+ * isn't allocated until it is queued or written.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <android/log.h>
+
+#include "glib-android.h"
+#include "glib-android-private.h"
+
+#define LOG_RECORD_TAG_SIZE     32
+#define LOG_RECORD_MESSAGE_SIZE 476     /* records of 512 bytes */
+#define LOG_WRITER_BATCH        32
+#define LOG_MAX_RECORDS         (1 << 16)       /* a ring of 32 MiB */
+
+/* the maximum payload of a logcat entry */
+#define LOG_TAG_SIZE            128
+#define LOG_TEXT_SIZE           4068
+#define LOG_FIELDS_BUFFER_SIZE  4096
+
+#define LOG_RATE_SITES_BITS     4
+#define LOG_RATE_SITES          (1 << LOG_RATE_SITES_BITS)
+#define LOG_REPEAT_INTERVAL     (10 * G_USEC_PER_SEC)
+
+typedef struct
+{
+  gint sequence;
+  gint priority;
+  gchar tag[LOG_RECORD_TAG_SIZE];
+  gchar message[LOG_RECORD_MESSAGE_SIZE];
+} GAndroidLogRecord;
+
+typedef struct
+{
+  gint64 tokens;                        /* in millionths of a message */
+  gint64 last_refill;
+} GAndroidLogBucket;
+
+typedef struct
+{
+  guint rate;
+  guint burst;
+  GAndroidLogBucket buckets[LOG_RATE_SITES];
+} GAndroidLogRateLimit;
+
+G_LOCK_DEFINE_STATIC (log_async);
+static GAndroidLogRecord *log_records;
+static guint log_mask;
+static gint log_enqueue_pos;
+static gint log_dequeue_pos;
+
+static gint log_async;                  /* TRUE while the writer thread runs */
+static gint log_overflow;
+static GThread *log_writer;
+
+/* the writer thread waits for records and the loggers for room with it */
+static GMutex log_mutex;
+static GCond log_records_cond;
+static GCond log_space_cond;
+static gboolean log_writer_quit;
+static gint log_writer_waiting;
+static gint log_n_blocked;
+
+/* serializes the writes of the records, keeping them in order */
+static GMutex log_write_mutex;
+
+static gint log_n_queued;
+static gint log_n_dropped;
+
+static GRWLock log_thresholds_lock;
+static GHashTable *log_thresholds;      /* domain -> mask of enabled levels */
+static gint log_n_thresholds;
+static gint log_default_mask = G_LOG_LEVEL_MASK;
+
+/* rate limits and repeats */
+static GMutex log_filter_mutex;
+static GHashTable *log_rate_limits;     /* domain -> GAndroidLogRateLimit */
+static GAndroidLogRateLimit *log_default_rate_limit;
+static gint log_n_rate_limits;
+static gint log_n_rate_limited;
+
+static gint log_collapse_repeats;
+static gchar log_last_tag[LOG_TAG_SIZE];
+static gchar log_last_message[LOG_TEXT_SIZE];
+static gsize log_last_len = G_MAXSIZE;  /* G_MAXSIZE when nothing to compare */
+static GLogLevelFlags log_last_level;
+static guint log_n_repeats;             /* since the last summary */
+static gint64 log_last_summary;
+static gint log_n_repeated;
+
+#if GLIB_CHECK_VERSION (2, 50, 0)
+static GAndroidLogFieldSink log_field_sink;
+static gpointer log_field_sink_data;
+#endif
+
+static android_LogPriority
+g_log_to_android_log (GLogLevelFlags flags)
+{
+  gint level;
+  static const android_LogPriority priorities[8] =
+    {
+      ANDROID_LOG_INFO,       /* (unused) G_LOG_FLAG_RECURSION */
+      ANDROID_LOG_INFO,       /* (unused) G_LOG_FLAG_FATAL */
+      ANDROID_LOG_FATAL,      /* G_LOG_LEVEL_ERROR */
+      ANDROID_LOG_ERROR,      /* G_LOG_LEVEL_CRITICAL */
+      ANDROID_LOG_WARN,       /* G_LOG_LEVEL_WARNING */
+      ANDROID_LOG_INFO,       /* G_LOG_LEVEL_MESSAGE */
+      ANDROID_LOG_INFO,       /* G_LOG_LEVEL_INFO */
+      ANDROID_LOG_DEBUG       /* G_LOG_LEVEL_DEBUG */
+    };
+
+  /* the most severe level, user defined levels are logged as info */
+  level = g_bit_nth_lsf (flags & G_LOG_LEVEL_MASK, -1);
+  if (level < 0 || level >= (gint) G_N_ELEMENTS (priorities))
+    return ANDROID_LOG_INFO;
+
+  return priorities[level];
+}
+
+/* Mask of the levels at least as severe as level */
+static gint
+level_to_mask (GLogLevelFlags level)
+{
+  gint least_severe;
+
+  least_severe = g_bit_nth_msf (level & G_LOG_LEVEL_MASK, -1);
+  if (least_severe < 0)
+    return 0;
+
+  return ((1 << (least_severe + 1)) - 1) & G_LOG_LEVEL_MASK;
+}
+
+static gint
+get_enabled_levels (const gchar *log_domain)
+{
+  gpointer mask;
+  gint levels;
+
+  if (G_LIKELY (g_atomic_int_get (&log_n_thresholds) == 0))
+    return g_atomic_int_get (&log_default_mask);
+
+  g_rw_lock_reader_lock (&log_thresholds_lock);
+  if (g_hash_table_lookup_extended (log_thresholds,
+                                    log_domain ? log_domain : "",
+                                    NULL, &mask))
+    levels = GPOINTER_TO_INT (mask);
+  else
+    levels = g_atomic_int_get (&log_default_mask);
+  g_rw_lock_reader_unlock (&log_thresholds_lock);
+
+  return levels;
+}
+
+/* Claims the record at the enqueue position, NULL if the ring is full */
+static GAndroidLogRecord *
+log_ring_reserve (guint *pos_)
+{
+  GAndroidLogRecord *record;
+  guint pos;
+  gint diff;
+
+  pos = g_atomic_int_get (&log_enqueue_pos);
+  for (;;)
+    {
+      record = &log_records[pos & log_mask];
+      diff = (gint) ((guint) g_atomic_int_get (&record->sequence) - pos);
+
+      if (diff < 0)
+        return NULL;
+
+      if (diff == 0 &&
+          g_atomic_int_compare_and_exchange (&log_enqueue_pos, pos, pos + 1))
+        {
+          *pos_ = pos;
+          return record;
+        }
+
+      pos = g_atomic_int_get (&log_enqueue_pos);
+    }
+}
+
+/* Takes the oldest record out of the ring, copying it to record if not NULL */
+static gboolean
+log_ring_pop (GAndroidLogRecord *record)
+{
+  GAndroidLogRecord *oldest;
+  guint pos;
+  gint diff;
+
+  pos = g_atomic_int_get (&log_dequeue_pos);
+  for (;;)
+    {
+      oldest = &log_records[pos & log_mask];
+      diff = (gint) ((guint) g_atomic_int_get (&oldest->sequence) - (pos + 1));
+
+      if (diff < 0)
+        return FALSE;
+
+      if (diff == 0 &&
+          g_atomic_int_compare_and_exchange (&log_dequeue_pos, pos, pos + 1))
+        break;
+
+      pos = g_atomic_int_get (&log_dequeue_pos);
+    }
+
+  if (record)
+    *record = *oldest;
+
+  g_atomic_int_set (&oldest->sequence, pos + log_mask + 1);
+
+  return TRUE;
+}
+
+static gboolean
+log_ring_is_empty (void)
+{
+  guint pos = g_atomic_int_get (&log_dequeue_pos);
+  GAndroidLogRecord *record = &log_records[pos & log_mask];
+
+  return (gint) ((guint) g_atomic_int_get (&record->sequence) - (pos + 1)) < 0;
+}
+
+static gboolean
+log_ring_is_full (void)
+{
+  guint pos = g_atomic_int_get (&log_enqueue_pos);
+  GAndroidLogRecord *record = &log_records[pos & log_mask];
+
+  return (gint) ((guint) g_atomic_int_get (&record->sequence) - pos) < 0;
+}
+
+static void
+log_write_record (const GAndroidLogRecord *record)
+{
+  __android_log_write (record->priority,
+                       record->tag[0] ? record->tag : NULL,
+                       record->message);
+}
+
+static void
+log_wake_blocked (void)
+{
+  if (g_atomic_int_get (&log_n_blocked) == 0)
+    return;
+
+  g_mutex_lock (&log_mutex);
+  g_cond_broadcast (&log_space_cond);
+  g_mutex_unlock (&log_mutex);
+}
+
+/* Returns FALSE if asynchronous logging has been disabled while waiting */
+static gboolean
+log_wait_for_space (void)
+{
+  gboolean async;
+
+  g_mutex_lock (&log_mutex);
+  g_atomic_int_inc (&log_n_blocked);
+  while (log_ring_is_full () && g_atomic_int_get (&log_async))
+    g_cond_wait (&log_space_cond, &log_mutex);
+  async = g_atomic_int_get (&log_async);
+  g_atomic_int_add (&log_n_blocked, -1);
+  g_mutex_unlock (&log_mutex);
+
+  return async;
+}
+
+/* Returns FALSE if the message has to be written synchronously */
+static gboolean
+log_queue (android_LogPriority  priority,
+           const gchar         *log_domain,
+           const gchar         *message)
+{
+  GAndroidLogRecord *record;
+  gsize tag_len, message_len;
+  guint pos;
+
+  tag_len = log_domain ? strlen (log_domain) : 0;
+  message_len = strlen (message);
+  if (tag_len >= LOG_RECORD_TAG_SIZE || message_len >= LOG_RECORD_MESSAGE_SIZE)
+    return FALSE;
+
+  while ((record = log_ring_reserve (&pos)) == NULL)
+    {
+      if (g_atomic_int_get (&log_overflow) == G_ANDROID_LOG_OVERFLOW_BLOCK)
+        {
+          if (!log_wait_for_space ())
+            return FALSE;
+        }
+      else if (log_ring_pop (NULL))
+        {
+          g_atomic_int_inc (&log_n_dropped);
+        }
+    }
+
+  record->priority = priority;
+  memcpy (record->tag, log_domain ? log_domain : "", tag_len + 1);
+  memcpy (record->message, message, message_len + 1);
+  g_atomic_int_set (&record->sequence, pos + 1);
+  g_atomic_int_inc (&log_n_queued);
+
+  /* the writer may have quit in the meantime */
+  if (G_UNLIKELY (!g_atomic_int_get (&log_async)))
+    {
+      g_android_log_flush ();
+    }
+  else if (g_atomic_int_get (&log_writer_waiting))
+    {
+      g_mutex_lock (&log_mutex);
+      g_cond_signal (&log_records_cond);
+      g_mutex_unlock (&log_mutex);
+    }
+
+  return TRUE;
+}
+
+static gpointer
+log_writer_thread (gpointer user_data)
+{
+  GAndroidLogRecord record;
+  gboolean quit;
+  guint n;
+
+  for (;;)
+    {
+      g_mutex_lock (&log_write_mutex);
+      for (n = 0; n < LOG_WRITER_BATCH && log_ring_pop (&record); n++)
+        log_write_record (&record);
+      g_mutex_unlock (&log_write_mutex);
+
+      if (n > 0)
+        {
+          log_wake_blocked ();
+          continue;
+        }
+
+      g_mutex_lock (&log_mutex);
+      g_atomic_int_set (&log_writer_waiting, TRUE);
+      while (log_ring_is_empty () && !log_writer_quit)
+        g_cond_wait (&log_records_cond, &log_mutex);
+      g_atomic_int_set (&log_writer_waiting, FALSE);
+      quit = log_writer_quit && log_ring_is_empty ();
+      g_mutex_unlock (&log_mutex);
+
+      if (quit)
+        break;
+    }
+
+  return NULL;
+}
+
+/*
+ * Reads the thresholds of G_ANDROID_LOG_LEVELS, made of logcat like filters
+ * separated by spaces or commas: "GLib:W MyApp:D *:I"
+ */
+void
+_g_android_log_init (void)
+{
+  const gchar *spec;
+  gchar **filters, *colon;
+  GLogLevelFlags level;
+  guint i;
+
+  spec = g_getenv ("G_ANDROID_LOG_LEVELS");
+  if (spec == NULL)
+    return;
+
+  filters = g_strsplit_set (spec, " ,", -1);
+  for (i = 0; filters[i]; i++)
+    {
+      if (filters[i][0] == '\0')
+        continue;
+
+      colon = strrchr (filters[i], ':');
+      if (colon == NULL || colon[1] == '\0' || colon[2] != '\0')
+        goto invalid;
+
+      switch (colon[1])
+        {
+        case 'V':
+        case 'D':
+          level = G_LOG_LEVEL_DEBUG;
+          break;
+        case 'I':
+          level = G_LOG_LEVEL_INFO;
+          break;
+        case 'W':
+          level = G_LOG_LEVEL_WARNING;
+          break;
+        case 'E':
+          level = G_LOG_LEVEL_CRITICAL;
+          break;
+        case 'F':
+          level = G_LOG_LEVEL_ERROR;
+          break;
+        case 'S':
+          level = 0;
+          break;
+        default:
+          goto invalid;
+        }
+
+      *colon = '\0';
+      g_android_log_set_threshold (filters[i], level);
+      continue;
+
+    invalid:
+      __android_log_print (ANDROID_LOG_WARN, G_LOG_DOMAIN,
+                           "Invalid filter '%s' in G_ANDROID_LOG_LEVELS",
+                           filters[i]);
+    }
+
+  g_strfreev (filters);
+}
+
+static gboolean
+is_log_enabled (const gchar    *log_domain,
+                GLogLevelFlags  log_level)
+{
+  return (log_level & (get_enabled_levels (log_domain) | G_LOG_FLAG_FATAL));
+}
+
+static void
+log_write (const gchar    *log_domain,
+           GLogLevelFlags  log_level,
+           const gchar    *message)
+{
+  gboolean is_fatal = (log_level & G_LOG_FLAG_FATAL);
+  android_LogPriority android_level;
+
+  if (is_fatal)
+    android_level = ANDROID_LOG_FATAL;
+  else
+    android_level = g_log_to_android_log (log_level);
+
+  if (_g_android_trace_write (android_level, log_domain, message) &&
+      !is_fatal)
+    return;
+
+  if (g_atomic_int_get (&log_async))
+    {
+      if (!is_fatal && log_queue (android_level, log_domain, message))
+        return;
+
+      g_android_log_flush ();
+    }
+
+  __android_log_write (android_level, log_domain, message);
+}
+
+/* Takes the repeats of the previous message, to be summarized */
+static guint
+log_take_repeats (gchar          *tag,
+                  GLogLevelFlags *level)
+{
+  guint n_repeats = log_n_repeats;
+
+  log_n_repeats = 0;
+  if (n_repeats > 0)
+    {
+      strcpy (tag, log_last_tag);
+      *level = log_last_level;
+    }
+
+  return n_repeats;
+}
+
+static void
+log_write_repeats (const gchar    *tag,
+                   GLogLevelFlags  level,
+                   guint           n_repeats)
+{
+  gchar text[64];
+
+  if (n_repeats == 0)
+    return;
+
+  g_snprintf (text, sizeof (text), "last message repeated %u times",
+              n_repeats);
+  log_write (tag[0] ? tag : NULL, level, text);
+}
+
+/* Returns TRUE if message is the same as the last one written, counting it
+ * as a repeat */
+static gboolean
+log_is_repeat (const gchar    *log_domain,
+               GLogLevelFlags  log_level,
+               const gchar    *message)
+{
+  gchar tag[LOG_TAG_SIZE];
+  GLogLevelFlags level = 0;
+  guint n_repeats = 0;
+  gboolean repeat;
+  gsize len;
+  gint64 now;
+
+  if (log_domain == NULL)
+    log_domain = "";
+  len = strlen (message);
+
+  g_mutex_lock (&log_filter_mutex);
+
+  repeat = len == log_last_len && log_level == log_last_level &&
+           memcmp (message, log_last_message, len) == 0 &&
+           strcmp (log_domain, log_last_tag) == 0;
+
+  if (repeat)
+    {
+      log_n_repeats++;
+
+      /* don't keep a long run of repeats hidden until the next message */
+      now = g_get_monotonic_time ();
+      if (now - log_last_summary >= LOG_REPEAT_INTERVAL)
+        {
+          n_repeats = log_take_repeats (tag, &level);
+          log_last_summary = now;
+        }
+    }
+
+  g_mutex_unlock (&log_filter_mutex);
+
+  if (repeat)
+    g_atomic_int_inc (&log_n_repeated);
+  log_write_repeats (tag, level, n_repeats);
+
+  return repeat;
+}
+
+/* Makes message, about to be written, the one the next ones are compared to,
+ * after having summarized the repeats of the previous one */
+static void
+log_set_last (const gchar    *log_domain,
+              GLogLevelFlags  log_level,
+              const gchar    *message)
+{
+  gchar tag[LOG_TAG_SIZE];
+  GLogLevelFlags level = 0;
+  guint n_repeats;
+  gsize tag_len, len;
+
+  if (log_domain == NULL)
+    log_domain = "";
+  tag_len = strlen (log_domain);
+  len = strlen (message);
+
+  g_mutex_lock (&log_filter_mutex);
+
+  n_repeats = log_take_repeats (tag, &level);
+
+  if (len < sizeof (log_last_message) && tag_len < sizeof (log_last_tag))
+    {
+      memcpy (log_last_message, message, len + 1);
+      memcpy (log_last_tag, log_domain, tag_len + 1);
+      log_last_len = len;
+      log_last_level = log_level;
+      log_last_summary = g_get_monotonic_time ();
+    }
+  else
+    {
+      log_last_len = G_MAXSIZE;
+    }
+
+  g_mutex_unlock (&log_filter_mutex);
+
+  log_write_repeats (tag, level, n_repeats);
+}
+
+/* Returns TRUE if the token bucket of the call site has a message to spare */
+static gboolean
+log_take_token (const gchar *log_domain,
+                gsize        call_site)
+{
+  GAndroidLogRateLimit *limit = NULL;
+  GAndroidLogBucket *bucket;
+  gboolean allowed;
+  gint64 now;
+
+  g_mutex_lock (&log_filter_mutex);
+
+  if (log_rate_limits)
+    limit = g_hash_table_lookup (log_rate_limits,
+                                 log_domain ? log_domain : "");
+  if (limit == NULL)
+    limit = log_default_rate_limit;
+  if (limit == NULL)
+    {
+      g_mutex_unlock (&log_filter_mutex);
+      return TRUE;
+    }
+
+  /* call sites sharing a bucket share their budget. Call sites are mostly
+   * aligned addresses, the top bits of the product are the well mixed ones */
+  bucket = &limit->buckets[((guint32) call_site * 2654435761u) >>
+                           (32 - LOG_RATE_SITES_BITS)];
+
+  now = g_get_monotonic_time ();
+  bucket->tokens = MIN (bucket->tokens + (now - bucket->last_refill) *
+                                         limit->rate,
+                        (gint64) limit->burst * G_USEC_PER_SEC);
+  bucket->last_refill = now;
+
+  allowed = bucket->tokens >= G_USEC_PER_SEC;
+  if (allowed)
+    bucket->tokens -= G_USEC_PER_SEC;
+
+  g_mutex_unlock (&log_filter_mutex);
+
+  if (!allowed)
+    g_atomic_int_inc (&log_n_rate_limited);
+
+  return allowed;
+}
+
+/*
+ * Returns FALSE if the message is a repeat or is over its rate limit. The
+ * call site is 0 when unknown, fatal messages always go through. Only the
+ * messages going through become the last message repeats are compared to, a
+ * message dropped by its rate limit doesn't end a run of repeats.
+ */
+static gboolean
+log_filter (const gchar    *log_domain,
+            GLogLevelFlags  log_level,
+            const gchar    *message,
+            gsize           call_site)
+{
+  if (log_level & G_LOG_FLAG_FATAL)
+    return TRUE;
+
+  if (g_atomic_int_get (&log_collapse_repeats) &&
+      log_is_repeat (log_domain, log_level, message))
+    return FALSE;
+
+  if (g_atomic_int_get (&log_n_rate_limits) > 0 &&
+      !log_take_token (log_domain, call_site))
+    return FALSE;
+
+  if (g_atomic_int_get (&log_collapse_repeats))
+    log_set_last (log_domain, log_level, message);
+
+  return TRUE;
+}
+
+void
+_g_android_log_handler (const gchar    *log_domain,
+                        GLogLevelFlags  log_level,
+                        const gchar    *message,
+                        gpointer        user_data)
+{
+  if (!is_log_enabled (log_domain, log_level) ||
+      !log_filter (log_domain, log_level, message, 0))
+    return;
+
+  log_write (log_domain, log_level, message);
+}
+
+#if GLIB_CHECK_VERSION (2, 50, 0)
+
+/* Appends at most length bytes of str, -1 for all of it, to text */
+static void
+append_text (gchar       *text,
+             gsize       *len,
+             const gchar *str,
+             gssize       length)
+{
+  gsize n;
+
+  n = length < 0 ? strlen (str) : (gsize) length;
+  n = MIN (n, LOG_TEXT_SIZE - 1 - *len);
+  memcpy (text + *len, str, n);
+  *len += n;
+  text[*len] = '\0';
+}
+
+static guint8 *
+encode_varint (guint8  *p,
+               guint64  value)
+{
+  while (value >= 0x80)
+    {
+      *p++ = (value & 0x7f) | 0x80;
+      value >>= 7;
+    }
+  *p++ = value;
+
+  return p;
+}
+
+/* Encodes and hands the fields to the field sink, see GAndroidLogFieldSink */
+static void
+log_fields_to_sink (GLogLevelFlags  log_level,
+                    const GLogField *fields,
+                    gsize            n_fields)
+{
+  guint8 buffer[LOG_FIELDS_BUFFER_SIZE], *p, *end;
+  gsize i, key_len, value_len;
+
+  p = buffer;
+  end = buffer + sizeof (buffer);
+
+  p = encode_varint (p, g_get_monotonic_time ());
+  p = encode_varint (p, log_level);
+
+  for (i = 0; i < n_fields; i++)
+    {
+      key_len = strlen (fields[i].key);
+      value_len = fields[i].length < 0 ? strlen (fields[i].value) :
+                                          (gsize) fields[i].length;
+
+      /* two varints of at most 10 bytes */
+      if (key_len + value_len + 20 > (gsize) (end - p))
+        break;
+
+      p = encode_varint (p, key_len);
+      memcpy (p, fields[i].key, key_len);
+      p += key_len;
+      p = encode_varint (p, value_len);
+      memcpy (p, fields[i].value, value_len);
+      p += value_len;
+    }
+
+  log_field_sink (buffer, p - buffer, log_field_sink_data);
+}
+
+/**
+ * g_android_log_writer:
+ * @log_level: the log level of the message
+ * @fields: the fields of the message
+ * @n_fields: the number of elements of @fields
+ * @user_data: unused
+ *
+ * #GLogWriterFunc installed by g_android_init(), writing the messages of
+ * g_log_structured() to the Android log like the ones of g_log(). The tag is
+ * the GLIB_DOMAIN field and the text the MESSAGE field, followed by the
+ * CODE_FILE, CODE_LINE and CODE_FUNC fields and the other string fields as
+ * KEY=value, all formatted on the stack. Messages longer than the maximum
+ * size of a logcat entry are truncated.
+ *
+ * The messages go through the same thresholds, rate limits and repeat
+ * collapsing as the ones of g_log(), the rate limits applying per call site.
+ * Errors are fatal, they are always written, synchronously.
+ * The fields are also given to the sink set with
+ * g_android_log_set_field_sink(), if any.
+ *
+ * An application installing its own writer can't call g_android_init()
+ * after it, GLib aborts then, but can chain up to this function.
+ *
+ * Returns: %G_LOG_WRITER_HANDLED
+ */
+GLogWriterOutput
+g_android_log_writer (GLogLevelFlags   log_level,
+                      const GLogField *fields,
+                      gsize            n_fields,
+                      gpointer         user_data)
+{
+  const GLogField *field, *domain, *message, *file, *line, *func;
+  gchar tag[LOG_TAG_SIZE], text[LOG_TEXT_SIZE];
+  const gchar *log_domain;
+  gsize i, len, call_site;
+
+  domain = message = file = line = func = NULL;
+  for (i = 0; i < n_fields; i++)
+    {
+      field = &fields[i];
+
+      if (strcmp (field->key, "GLIB_DOMAIN") == 0)
+        domain = field;
+      else if (strcmp (field->key, "MESSAGE") == 0)
+        message = field;
+      else if (strcmp (field->key, "CODE_FILE") == 0)
+        file = field;
+      else if (strcmp (field->key, "CODE_LINE") == 0)
+        line = field;
+      else if (strcmp (field->key, "CODE_FUNC") == 0)
+        func = field;
+    }
+
+  /* field values are only nul-terminated when their length is -1 */
+  log_domain = NULL;
+  if (domain && domain->length < 0)
+    {
+      log_domain = domain->value;
+    }
+  else if (domain)
+    {
+      len = MIN ((gsize) domain->length, sizeof (tag) - 1);
+      memcpy (tag, domain->value, len);
+      tag[len] = '\0';
+      log_domain = tag;
+    }
+
+  /* g_log_structured() aborts after writing these but, unlike g_log(),
+   * doesn't flag them G_LOG_FLAG_FATAL */
+  if (log_level & G_LOG_FATAL_MASK)
+    log_level |= G_LOG_FLAG_FATAL;
+
+  if (!is_log_enabled (log_domain, log_level))
+    return G_LOG_WRITER_HANDLED;
+
+  len = 0;
+  text[0] = '\0';
+  if (message)
+    append_text (text, &len, message->value, message->length);
+
+  if (file)
+    {
+      append_text (text, &len, " [", -1);
+      append_text (text, &len, file->value, file->length);
+      if (line)
+        {
+          append_text (text, &len, ":", -1);
+          append_text (text, &len, line->value, line->length);
+        }
+      if (func)
+        {
+          append_text (text, &len, " ", -1);
+          append_text (text, &len, func->value, func->length);
+          append_text (text, &len, "()", -1);
+        }
+      append_text (text, &len, "]", -1);
+    }
+
+  /* the other string fields, binary ones are only given to the sink */
+  for (i = 0; i < n_fields; i++)
+    {
+      field = &fields[i];
+
+      if (field == domain || field == message || field == file ||
+          field == line || field == func || field->length >= 0 ||
+          strcmp (field->key, "PRIORITY") == 0 ||
+          strcmp (field->key, "GLIB_OLD_LOG_API") == 0)
+        continue;
+
+      append_text (text, &len, " ", -1);
+      append_text (text, &len, field->key, -1);
+      append_text (text, &len, "=", -1);
+      append_text (text, &len, field->value, -1);
+    }
+
+  /* CODE_FILE and CODE_LINE are usually string literals */
+  call_site = 0;
+  if (file && line)
+    call_site = GPOINTER_TO_SIZE (file->value) +
+                31 * GPOINTER_TO_SIZE (line->value);
+
+  if (!log_filter (log_domain, log_level, text, call_site))
+    return G_LOG_WRITER_HANDLED;
+
+  if (log_field_sink)
+    log_fields_to_sink (log_level, fields, n_fields);
+
+  log_write (log_domain, log_level, text);
+
+  return G_LOG_WRITER_HANDLED;
+}
+
+/**
+ * g_android_log_set_field_sink:
+ * @sink: (allow-none): the sink, or %NULL to remove it
+ * @user_data: data passed to @sink
+ *
+ * Hands the fields of the messages logged with g_log_structured(), encoded
+ * as described in #GAndroidLogFieldSink, to @sink in addition to writing
+ * them to the Android log. The messages dropped by the thresholds of their
+ * domain, their rate limit or as repeats aren't given to @sink either.
+ *
+ * Call this before logging anything.
+ */
+void
+g_android_log_set_field_sink (GAndroidLogFieldSink sink,
+                              gpointer             user_data)
+{
+  log_field_sink_data = user_data;
+  log_field_sink = sink;
+}
+
+#endif /* GLIB_CHECK_VERSION (2, 50, 0) */
+
+/**
+ * g_android_log_set_async:
+ * @async: whether to log asynchronously
+ * @n_records: the number of messages the ring can hold, rounded up to a
+ *   power of 2, at most 65536
+ * @overflow: what to do when the ring is full
+ *
+ * Makes the log handler installed by g_android_init() copy the messages into
+ * a ring written to the Android log by a dedicated thread, instead of writing
+ * them from the logging thread. Messages longer than about 470 bytes, or
+ * with a domain longer than 31 bytes, and fatal messages are still written
+ * synchronously.
+ *
+ * The ring is allocated by the first call enabling asynchronous logging and
+ * later calls keep its size. Disabling asynchronous logging writes the
+ * pending messages and stops the thread.
+ *
+ * Returns: %TRUE if the messages are now logged as requested
+ */
+gboolean
+g_android_log_set_async (gboolean            async,
+                         guint               n_records,
+                         GAndroidLogOverflow overflow)
+{
+  GAndroidLogRecord *records;
+  guint i, n;
+
+  g_return_val_if_fail (n_records <= LOG_MAX_RECORDS, FALSE);
+
+  G_LOCK (log_async);
+
+  g_atomic_int_set (&log_overflow, overflow);
+
+  if (async && log_writer == NULL)
+    {
+      if (log_records == NULL)
+        {
+          n = 2;
+          while (n < n_records)
+            n <<= 1;
+
+          records = g_new (GAndroidLogRecord, n);
+          for (i = 0; i < n; i++)
+            records[i].sequence = i;
+          log_mask = n - 1;
+          g_atomic_pointer_set (&log_records, records);
+        }
+
+      log_writer = g_thread_try_new ("glib-android-log", log_writer_thread,
+                                     NULL, NULL);
+      if (log_writer)
+        g_atomic_int_set (&log_async, TRUE);
+    }
+  else if (!async && log_writer)
+    {
+      g_atomic_int_set (&log_async, FALSE);
+
+      g_mutex_lock (&log_mutex);
+      log_writer_quit = TRUE;
+      g_cond_signal (&log_records_cond);
+      g_cond_broadcast (&log_space_cond);
+      g_mutex_unlock (&log_mutex);
+
+      g_thread_join (log_writer);
+      log_writer = NULL;
+      log_writer_quit = FALSE;
+
+      /* messages queued while the writer was quitting */
+      g_android_log_flush ();
+    }
+
+  G_UNLOCK (log_async);
+
+  return async == (log_writer != NULL);
+}
+
+/**
+ * g_android_log_flush:
+ *
+ * Writes the messages queued in asynchronous mode before returning, see
+ * g_android_log_set_async().
+ */
+void
+g_android_log_flush (void)
+{
+  GAndroidLogRecord record;
+
+  if (g_atomic_pointer_get (&log_records) == NULL)
+    return;
+
+  g_mutex_lock (&log_write_mutex);
+  while (log_ring_pop (&record))
+    log_write_record (&record);
+  g_mutex_unlock (&log_write_mutex);
+
+  log_wake_blocked ();
+}
+
+/**
+ * g_android_log_get_stats:
+ * @stats: (out): return location for the statistics
+ *
+ * Retrieves the counters of the log handler installed by g_android_init().
+ */
+void
+g_android_log_get_stats (GAndroidLogStats *stats)
+{
+  g_return_if_fail (stats != NULL);
+
+  stats->n_queued = g_atomic_int_get (&log_n_queued);
+  stats->n_dropped = g_atomic_int_get (&log_n_dropped);
+  stats->n_rate_limited = g_atomic_int_get (&log_n_rate_limited);
+  stats->n_repeated = g_atomic_int_get (&log_n_repeated);
+}
+
+/**
+ * g_android_log_set_threshold:
+ * @log_domain: a log domain, "" for the messages without a domain or "*" for
+ *   the domains without a threshold of their own
+ * @log_level: the least severe level logged, or 0 to only log fatal messages
+ *
+ * Drops the messages of @log_domain less severe than @log_level. The
+ * thresholds can also be given with the G_ANDROID_LOG_LEVELS environment
+ * variable read by g_android_init(), as logcat filters: "GLib:W MyApp:D *:I".
+ *
+ * GLib formats the messages before calling the log handler, guard costly
+ * debug messages with g_android_log_is_enabled() or use g_android_debug().
+ */
+void
+g_android_log_set_threshold (const gchar    *log_domain,
+                             GLogLevelFlags  log_level)
+{
+  gint mask;
+
+  g_return_if_fail (log_domain != NULL);
+
+  mask = level_to_mask (log_level);
+
+  if (strcmp (log_domain, "*") == 0)
+    {
+      g_atomic_int_set (&log_default_mask, mask);
+      return;
+    }
+
+  g_rw_lock_writer_lock (&log_thresholds_lock);
+  if (log_thresholds == NULL)
+    log_thresholds = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, NULL);
+  g_hash_table_replace (log_thresholds, g_strdup (log_domain),
+                        GINT_TO_POINTER (mask));
+  g_atomic_int_set (&log_n_thresholds, g_hash_table_size (log_thresholds));
+  g_rw_lock_writer_unlock (&log_thresholds_lock);
+}
+
+/**
+ * g_android_log_is_enabled:
+ * @log_domain: (allow-none): a log domain
+ * @log_level: a log level
+ *
+ * Tells whether a message of @log_domain at @log_level would be logged, see
+ * g_android_log_set_threshold().
+ *
+ * Returns: %TRUE if the message would be logged
+ */
+gboolean
+g_android_log_is_enabled (const gchar    *log_domain,
+                          GLogLevelFlags  log_level)
+{
+  return (log_level & get_enabled_levels (log_domain)) != 0;
+}
+
+/**
+ * g_android_log_set_rate_limit:
+ * @log_domain: a log domain, "" for the messages without a domain or "*" for
+ *   the domains without a rate limit of their own
+ * @rate: the number of messages per second, or 0 to remove the rate limit
+ * @burst: the number of messages that can be logged in a row
+ *
+ * Limits the messages of @log_domain with a token bucket holding up to
+ * @burst messages and refilled with @rate messages per second, dropping the
+ * messages logged once it is empty. The messages of g_log_structured() with
+ * a CODE_FILE and a CODE_LINE field are limited per call site, spread over
+ * 16 buckets, the other messages of @log_domain share one. Fatal messages
+ * are never dropped.
+ *
+ * The dropped messages are counted in #GAndroidLogStats.
+ */
+void
+g_android_log_set_rate_limit (const gchar *log_domain,
+                              guint        rate,
+                              guint        burst)
+{
+  GAndroidLogRateLimit *limit = NULL;
+  guint i, n_limits;
+  gint64 now;
+
+  g_return_if_fail (log_domain != NULL);
+
+  if (rate > 0)
+    {
+      limit = g_new (GAndroidLogRateLimit, 1);
+      limit->rate = rate;
+      limit->burst = MAX (burst, 1);
+
+      now = g_get_monotonic_time ();
+      for (i = 0; i < LOG_RATE_SITES; i++)
+        {
+          limit->buckets[i].tokens = (gint64) limit->burst * G_USEC_PER_SEC;
+          limit->buckets[i].last_refill = now;
+        }
+    }
+
+  g_mutex_lock (&log_filter_mutex);
+
+  if (strcmp (log_domain, "*") == 0)
+    {
+      g_free (log_default_rate_limit);
+      log_default_rate_limit = limit;
+    }
+  else
+    {
+      if (log_rate_limits == NULL)
+        log_rate_limits = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, g_free);
+      if (limit)
+        g_hash_table_replace (log_rate_limits, g_strdup (log_domain), limit);
+      else
+        g_hash_table_remove (log_rate_limits, log_domain);
+    }
+
+  n_limits = log_default_rate_limit != NULL;
+  if (log_rate_limits)
+    n_limits += g_hash_table_size (log_rate_limits);
+  g_atomic_int_set (&log_n_rate_limits, n_limits);
+
+  g_mutex_unlock (&log_filter_mutex);
+}
+
+/**
+ * g_android_log_set_collapse_repeats:
+ * @collapse: whether to collapse repeated messages
+ *
+ * Drops the messages identical to the previous one, with the same domain
+ * and level, and writes "last message repeated N times" instead, when a
+ * different message is logged or every 10 seconds while the message keeps
+ * being repeated. Messages longer than about 4 KiB are never collapsed.
+ *
+ * The dropped messages are counted in #GAndroidLogStats. Disabling the
+ * collapsing writes the pending count of repeats.
+ */
+void
+g_android_log_set_collapse_repeats (gboolean collapse)
+{
+  gchar tag[LOG_TAG_SIZE];
+  GLogLevelFlags level = 0;
+  guint n_repeats;
+
+  g_mutex_lock (&log_filter_mutex);
+  g_atomic_int_set (&log_collapse_repeats, collapse);
+  n_repeats = log_take_repeats (tag, &level);
+  log_last_len = G_MAXSIZE;
+  g_mutex_unlock (&log_filter_mutex);
+
+  log_write_repeats (tag, level, n_repeats);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+#ifndef __GLIB_ANDROID_PRIVATE_H__
+#define __GLIB_ANDROID_PRIVATE_H__
+
+#include <glib.h>
+
+#include <android/log.h>
+
+/* glib-android-log.c */
+void _g_android_log_init    (void);
+void _g_android_log_handler (const gchar    *log_domain,
+                             GLogLevelFlags  log_level,
+                             const gchar    *message,
+                             gpointer        user_data);
+
+/* glib-android-trace.c */
+gboolean _g_android_trace_write (android_LogPriority  priority,
+                                 const gchar         *log_domain,
+                                 const gchar         *message);
+
+#endif /* __GLIB_ANDROID_PRIVATE_H__ */
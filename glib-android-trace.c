@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * Trace files. g_android_log_set_trace_file() maps a file shared with the
+ * page cache and the messages are copied into its ring of slots instead of
+ * being sent to logd, see glib-android-trace.h for the format. Claiming
+ * slots is a single atomic add on the write position stored in the file, so
+ * loggers never wait for each other, and as the kernel owns the pages the
+ * messages written before a crash end up in the file.
+ *
+ * The domains are stored once in a table in the header of the file and the
+ * records only carry their index. The loggers look the domain strings up by
+ * address in a cache, G_LOG_DOMAIN being a string literal, and only take a
+ * lock to compare their name with the table when they miss.
+ *
+ * The loggers count themselves in trace_n_writers while they use the
+ * mapping, so it can be unmapped once the pointer to it is cleared and the
+ * count has dropped to 0.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "glib-android.h"
+#include "glib-android-private.h"
+#include "glib-android-trace.h"
+
+#define TRACE_DOMAIN_CACHE_SIZE 64
+
+/* the largest ring, a 2 GiB file */
+#define TRACE_MAX_RECORDS (1 << 24)
+
+/* how far the wall clock may have been set since a trace was started before
+ * we append to it */
+#define TRACE_MAX_CLOCK_DRIFT (60 * G_USEC_PER_SEC)
+
+G_LOCK_DEFINE_STATIC (trace);
+static GAndroidTraceHeader *trace;
+static gsize trace_size;
+static gint trace_n_writers;
+
+/* domain -> domain id, keyed by the content of the domain as the log
+ * functions can give us copies on the stack. The entries are set before
+ * being counted */
+typedef struct
+{
+  guint hash;
+  guint8 id;
+  gchar name[G_ANDROID_TRACE_DOMAIN_SIZE];
+} TraceDomain;
+
+G_LOCK_DEFINE_STATIC (trace_domains);
+static TraceDomain trace_domains_cache[TRACE_DOMAIN_CACHE_SIZE];
+static gint trace_n_cached_domains;
+
+static GPrivate trace_tid;
+
+static guint32
+get_tid (void)
+{
+  gpointer tid;
+
+  tid = g_private_get (&trace_tid);
+  if (G_UNLIKELY (tid == NULL))
+    {
+      tid = GUINT_TO_POINTER ((guint) syscall (SYS_gettid));
+      g_private_set (&trace_tid, tid);
+    }
+
+  return GPOINTER_TO_UINT (tid);
+}
+
+/* Hash of the part of the domain that fits in the domain table */
+static guint
+hash_domain (const gchar *log_domain)
+{
+  guint hash = 5381;
+  gint i;
+
+  for (i = 0; i < G_ANDROID_TRACE_DOMAIN_SIZE - 1 && log_domain[i]; i++)
+    hash = hash * 33 + (guchar) log_domain[i];
+
+  return hash;
+}
+
+static guint8
+lookup_domain (GAndroidTraceHeader *header,
+               const gchar         *log_domain)
+{
+  guint8 id = G_ANDROID_TRACE_DOMAIN_OTHER;
+  TraceDomain *domain;
+  guint hash;
+  gint i, n;
+
+  hash = hash_domain (log_domain);
+
+  n = g_atomic_int_get (&trace_n_cached_domains);
+  for (i = 0; i < n; i++)
+    {
+      domain = &trace_domains_cache[i];
+      if (domain->hash == hash &&
+          strncmp (domain->name, log_domain,
+                   G_ANDROID_TRACE_DOMAIN_SIZE - 1) == 0)
+        return domain->id;
+    }
+
+  G_LOCK (trace_domains);
+
+  for (i = 0; i < (gint) header->n_domains; i++)
+    if (strncmp (header->domains[i], log_domain,
+                 G_ANDROID_TRACE_DOMAIN_SIZE - 1) == 0)
+      break;
+
+  if (i < (gint) header->n_domains)
+    {
+      id = i + 1;
+    }
+  else if (header->n_domains < G_ANDROID_TRACE_N_DOMAINS)
+    {
+      g_strlcpy (header->domains[i], log_domain, G_ANDROID_TRACE_DOMAIN_SIZE);
+      header->n_domains++;
+      id = i + 1;
+    }
+
+  n = trace_n_cached_domains;
+  if (n < TRACE_DOMAIN_CACHE_SIZE)
+    {
+      domain = &trace_domains_cache[n];
+      domain->hash = hash;
+      domain->id = id;
+      g_strlcpy (domain->name, log_domain, G_ANDROID_TRACE_DOMAIN_SIZE);
+      g_atomic_int_set (&trace_n_cached_domains, n + 1);
+    }
+
+  G_UNLOCK (trace_domains);
+
+  return id;
+}
+
+static gpointer
+get_slot (GAndroidTraceHeader *header,
+          guint32              pos)
+{
+  guint8 *slots = (guint8 *) header + G_ANDROID_TRACE_DATA_OFFSET;
+
+  return slots + (pos & (header->n_slots - 1)) * G_ANDROID_TRACE_SLOT_SIZE;
+}
+
+static void
+write_record (GAndroidTraceHeader *header,
+              android_LogPriority  priority,
+              const gchar         *log_domain,
+              const gchar         *message)
+{
+  GAndroidTraceRecord *record;
+  GAndroidTraceContinuation *continuation;
+  gsize length, offset, n;
+  guint32 pos;
+  guint i, n_slots;
+  guint8 flags = 0;
+
+  length = strlen (message);
+  if (length > G_ANDROID_TRACE_MAX_MESSAGE)
+    {
+      length = G_ANDROID_TRACE_MAX_MESSAGE;
+      flags |= G_ANDROID_TRACE_FLAG_TRUNCATED;
+    }
+
+  n_slots = 1;
+  if (length > sizeof (record->message))
+    n_slots += (length - sizeof (record->message) +
+                sizeof (continuation->message) - 1) /
+               sizeof (continuation->message);
+
+  pos = g_atomic_int_add ((gint *) &header->write_pos, n_slots);
+
+  /* the slots may still hold a record the decoder would think complete */
+  for (i = 0; i < n_slots; i++)
+    {
+      continuation = get_slot (header, pos + i);
+      g_atomic_int_set ((gint *) &continuation->sequence, 0);
+    }
+
+  offset = MIN (length, sizeof (record->message));
+  for (i = 1; i < n_slots; i++)
+    {
+      continuation = get_slot (header, pos + i);
+      n = MIN (length - offset, sizeof (continuation->message));
+      continuation->n_slots = 0;
+      memcpy (continuation->message, message + offset, n);
+      offset += n;
+      g_atomic_int_set ((gint *) &continuation->sequence, pos + i + 1);
+    }
+
+  record = get_slot (header, pos);
+  record->n_slots = n_slots;
+  record->priority = priority;
+  record->domain = log_domain ? lookup_domain (header, log_domain) :
+                                G_ANDROID_TRACE_DOMAIN_NONE;
+  record->flags = flags;
+  record->tid = get_tid ();
+  record->length = length;
+  record->time = g_get_monotonic_time ();
+  memcpy (record->message, message, MIN (length, sizeof (record->message)));
+  g_atomic_int_set ((gint *) &record->sequence, pos + 1);
+}
+
+/* Returns FALSE if there is no trace file to write the message to */
+gboolean
+_g_android_trace_write (android_LogPriority  priority,
+                        const gchar         *log_domain,
+                        const gchar         *message)
+{
+  GAndroidTraceHeader *header;
+
+  if (G_LIKELY (g_atomic_pointer_get (&trace) == NULL))
+    return FALSE;
+
+  g_atomic_int_inc (&trace_n_writers);
+  header = g_atomic_pointer_get (&trace);
+  if (header)
+    write_record (header, priority, log_domain, message);
+  g_atomic_int_add (&trace_n_writers, -1);
+
+  return header != NULL;
+}
+
+static void
+close_trace (void)
+{
+  GAndroidTraceHeader *header = trace;
+
+  if (header == NULL)
+    return;
+
+  g_atomic_pointer_set (&trace, NULL);
+  while (g_atomic_int_get (&trace_n_writers) > 0)
+    g_thread_yield ();
+
+  munmap (header, trace_size);
+  trace_size = 0;
+
+  g_atomic_int_set (&trace_n_cached_domains, 0);
+}
+
+static gboolean
+open_trace (const gchar  *filename,
+            guint         n_slots,
+            GError      **error)
+{
+  GAndroidTraceHeader *header;
+  struct stat st;
+  gint64 now, real_now;
+  gsize size;
+  gint fd;
+
+  size = G_ANDROID_TRACE_DATA_OFFSET + (gsize) n_slots *
+                                       G_ANDROID_TRACE_SLOT_SIZE;
+
+  fd = open (filename, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    goto error;
+
+  if (fstat (fd, &st) < 0 ||
+      ((gsize) st.st_size != size && ftruncate (fd, size) < 0))
+    {
+      close (fd);
+      goto error;
+    }
+
+  header = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (header == MAP_FAILED)
+    goto error;
+
+  /* keep appending to a trace left by a previous run, with its base times
+   * for its records to be decoded right, unless the clocks don't match them
+   * anymore, after a reboot */
+  now = g_get_monotonic_time ();
+  real_now = g_get_real_time ();
+  if (memcmp (header->magic, G_ANDROID_TRACE_MAGIC, sizeof (header->magic)) ||
+      header->version != G_ANDROID_TRACE_VERSION ||
+      header->n_slots != n_slots ||
+      header->n_domains > G_ANDROID_TRACE_N_DOMAINS ||
+      now < header->base_monotonic_time ||
+      ABS (header->base_real_time + (now - header->base_monotonic_time) -
+           real_now) > TRACE_MAX_CLOCK_DRIFT)
+    {
+      memset (header, 0, size);
+      memcpy (header->magic, G_ANDROID_TRACE_MAGIC, sizeof (header->magic));
+      header->version = G_ANDROID_TRACE_VERSION;
+      header->n_slots = n_slots;
+      header->base_monotonic_time = now;
+      header->base_real_time = real_now;
+    }
+
+  trace_size = size;
+  g_atomic_pointer_set (&trace, header);
+
+  return TRUE;
+
+error:
+  g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+               "Could not map '%s': %s", filename, g_strerror (errno));
+  return FALSE;
+}
+
+/**
+ * g_android_log_set_trace_file:
+ * @filename: (allow-none): the trace file, or %NULL to stop tracing
+ * @n_records: the number of slots of 128 bytes of the file, rounded up to a
+ *   power of 2 between 8 and 2^24
+ * @error: return location for a #GError, or %NULL
+ *
+ * Writes the messages to @filename instead of the Android log, as binary
+ * records in a ring of @n_records slots: the newest messages overwrite the
+ * oldest ones. A message takes one slot, plus one for every 120 bytes beyond
+ * the first 104, and is truncated past 944 bytes. Fatal messages are written
+ * to the Android log as well.
+ *
+ * The file is mapped in memory, so writing a message doesn't involve any
+ * system call and the messages logged before the process crashed can still
+ * be read from the file. If @filename already holds a trace with the same
+ * number of slots, the new messages are appended to it, unless the device
+ * rebooted meanwhile. The host tool glib-android-trace decodes the file.
+ *
+ * Returns: %TRUE if the messages are now logged as requested
+ */
+gboolean
+g_android_log_set_trace_file (const gchar  *filename,
+                              guint         n_records,
+                              GError      **error)
+{
+  gboolean ret = TRUE;
+  guint n;
+
+  g_return_val_if_fail (n_records <= TRACE_MAX_RECORDS, FALSE);
+
+  G_LOCK (trace);
+
+  close_trace ();
+
+  if (filename)
+    {
+      /* a record of G_ANDROID_TRACE_MAX_SLOTS has to fit */
+      n = G_ANDROID_TRACE_MAX_SLOTS;
+      while (n < n_records)
+        n <<= 1;
+
+      ret = open_trace (filename, n, error);
+    }
+
+  G_UNLOCK (trace);
+
+  return ret;
+}
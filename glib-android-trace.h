@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * Format of the trace files written by g_android_log_set_trace_file() and
+ * read by tools/glib-android-trace. Numbers are in the byte order of the
+ * device, that is little endian.
+ *
+ * The file starts with a GAndroidTraceHeader, padded to
+ * G_ANDROID_TRACE_DATA_OFFSET bytes, followed by a ring of n_slots slots of
+ * G_ANDROID_TRACE_SLOT_SIZE bytes. A message takes a GAndroidTraceRecord
+ * slot, followed by as many GAndroidTraceContinuation slots as needed to
+ * hold the rest of its text.
+ *
+ * write_pos counts the slots claimed since the file was created, wrapping
+ * around at 2^32, the slot at position pos being slot pos % n_slots of the
+ * ring. Each slot holds its position + 1 in sequence, written once the slot
+ * is filled and cleared before, so a slot belongs to the last n_slots
+ * positions only if write_pos - sequence < n_slots. A record is complete if
+ * all its slots have consecutive sequences.
+ */
+
+#ifndef __GLIB_ANDROID_TRACE_H__
+#define __GLIB_ANDROID_TRACE_H__
+
+#include <glib.h>
+
+#define G_ANDROID_TRACE_MAGIC           "GATRACE1"
+#define G_ANDROID_TRACE_VERSION         1
+
+#define G_ANDROID_TRACE_DATA_OFFSET     4096
+#define G_ANDROID_TRACE_SLOT_SIZE       128
+#define G_ANDROID_TRACE_MAX_SLOTS       8
+
+#define G_ANDROID_TRACE_N_DOMAINS       64
+#define G_ANDROID_TRACE_DOMAIN_SIZE     32
+#define G_ANDROID_TRACE_DOMAIN_NONE     0       /* no domain */
+#define G_ANDROID_TRACE_DOMAIN_OTHER    255     /* the domain table was full */
+
+#define G_ANDROID_TRACE_FLAG_TRUNCATED  (1 << 0)
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 n_slots;                      /* a power of 2 */
+  guint32 write_pos;
+  guint32 n_domains;
+
+  /* to turn the monotonic time of the records into wall clock time */
+  gint64 base_monotonic_time;
+  gint64 base_real_time;
+
+  /* nul-terminated, domain id n is domains[n - 1] */
+  gchar domains[G_ANDROID_TRACE_N_DOMAINS][G_ANDROID_TRACE_DOMAIN_SIZE];
+} GAndroidTraceHeader;
+
+typedef struct
+{
+  guint32 sequence;                     /* 0 while being written */
+  guint8 n_slots;                       /* slots of the record */
+  guint8 priority;                      /* android_LogPriority */
+  guint8 domain;
+  guint8 flags;
+  guint32 tid;
+  guint32 length;                       /* of the message, in bytes */
+  gint64 time;                          /* monotonic, in microseconds */
+  gchar message[G_ANDROID_TRACE_SLOT_SIZE - 24];
+} GAndroidTraceRecord;
+
+typedef struct
+{
+  guint32 sequence;
+  guint8 n_slots;                       /* 0 */
+  guint8 padding[3];
+  gchar message[G_ANDROID_TRACE_SLOT_SIZE - 8];
+} GAndroidTraceContinuation;
+
+/* the longest message a record can hold */
+#define G_ANDROID_TRACE_MAX_MESSAGE                                     \
+  (sizeof (((GAndroidTraceRecord *) NULL)->message) +                   \
+   (G_ANDROID_TRACE_MAX_SLOTS - 1) *                                    \
+   sizeof (((GAndroidTraceContinuation *) NULL)->message))
+
+#endif /* __GLIB_ANDROID_TRACE_H__ */
@@ -36,18 +36,40 @@
  *  Damien Lespiau <damien.lespiau@gmail.com>
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
 
 #include <android/log.h>
 #include <android/looper.h>
+#include <android/sensor.h>
 
 #include <android_native_app_glue.h>
 
 #include "glib-android.h"
+#include "glib-android-private.h"
 
 #define G_ANDROID_DEBUG 0
 
+/*
+ * Sources owning an fd they register with the looper themselves, like the
+ * ASensorEventQueue of a sensor source, use this ident with the source as
+ * data. g_android_poll() marks them pending when their fd is ready. Apps
+ * number their own idents up from LOOPER_ID_USER, this one is taken from the
+ * other end of the range.
+ */
+#define LOOPER_ID_SOURCE (G_MAXINT32 - 1)
+
 #if G_ANDROID_DEBUG
 
 #define G_ANDROID_NOTE(fmt,args...) g_debug (G_STRLOC ": " fmt, ##args);
@@ -55,8 +77,6 @@
 static const gchar *
 looper_id_to_string (int id)
 {
-  static gchar buffer[32];
-
   if (id == LOOPER_ID_MAIN)
     return "MAIN";
 
@@ -66,11 +86,8 @@ looper_id_to_string (int id)
   if (id == LOOPER_ID_USER)
     return "USER";
 
-  if (id > LOOPER_ID_USER)
-    {
-      g_snprintf (buffer, 32, "USER + %d", id);
-      return buffer;
-    }
+  if (id == LOOPER_ID_SOURCE)
+    return "SOURCE";
 
   return "Unknown id";
 }
@@ -80,49 +97,6 @@ looper_id_to_string (int id)
 
 #endif
 
-static android_LogPriority
-g_log_to_android_log (GLogLevelFlags flags)
-{
-  guint i;
-  static long levels[8] =
-    {
-      0,                      /* (unused) ANDROID_LOG_UNKNOWN */
-      0,                      /* (unused) ANDROID_LOG_DEFAULT */
-      G_LOG_LEVEL_MESSAGE,    /* ANDROID_LOG_VERBOSE */
-      G_LOG_LEVEL_DEBUG,      /* ANDROID_LOG_DEBUG */
-      G_LOG_LEVEL_INFO,       /* ANDROID_LOG_INFO */
-      G_LOG_LEVEL_WARNING,    /* ANDROID_LOG_WARN */
-      G_LOG_LEVEL_CRITICAL,   /* ANDROID_LOG_ERROR */
-      G_LOG_LEVEL_ERROR       /* ANDROID_LOG_FATAL */
-    };
-
-  for (i = 3; i < G_N_ELEMENTS (levels); i++)
-    if (flags & levels [i])
-      break;
-
-  if (i == G_N_ELEMENTS (levels))
-    return ANDROID_LOG_INFO;
-
-  return i;
-}
-
-static void
-g_android_log_handler (const gchar    *log_domain,
-                       GLogLevelFlags  log_level,
-                       const gchar    *message,
-                       gpointer        user_data)
-{
-  gboolean is_fatal = (log_level & G_LOG_FLAG_FATAL);
-  android_LogPriority android_level;
-
-  if (is_fatal)
-    android_level = ANDROID_LOG_FATAL;
-  else
-    android_level = g_log_to_android_log (log_level);
-
-  __android_log_write (android_level, log_domain, message);
-}
-
 static gint
 g_io_condition_to_looper_event (GIOCondition condition)
 {
@@ -168,213 +142,3227 @@ looper_event_to_g_io_condition (int events)
 
   return flags;
 }
+
 /*
- * It's totally fine to have a static variable to hold the state between two
- * g_android_poll() invocations as I only plan to use this function for GLib's
- * default context only. I assume that you want integration with ALooper for
- * events and sensors from the GLib's main thread, the other threads can then
- * just the the normal polling function.
+ * The state kept between two g_android_poll() invocations lives in a
+ * thread-local GAndroidPollState, along with the ALooper of that thread. A
+ * GMainContext is driven by one thread at a time, so each thread running an
+ * attached context gets its own looper. Contexts run by different threads
+ * don't share anything and can poll in parallel.
+ *
+ * Each context has its own registry, a GAndroidFdRegistry kept by its looper
+ * source, so a thread alternating between contexts, eg. running a nested
+ * iteration of a private context from a dispatch of the default one, doesn't
+ * register the fds of one context again each time it polls the other. The
+ * looper is still shared: the poll state maps each fd added to it to the
+ * registry entry it was added for. The looper only knows an fd once, a context
+ * adding an fd another one had added takes it over, and the other context
+ * adds it back the next time it polls. An fd of another context reported while
+ * polling is removed from the looper the same way, to not spin on it while
+ * that context waits for the nested iteration to return.
+ *
+ * We keep a registry of the fds currently added to the ALooper, indexed by fd,
+ * to only call ALooper_addFd() and ALooper_removeFd() when an fd appears in,
+ * disappears from or changes its events in the array GLib gives us. In the
+ * steady state, g_android_poll() does not issue any registration syscall.
+ *
+ * All the fds share the LOOPER_ID_USER ident: the looper hands us back the fd
+ * that woke us up and the registry maps it to its current slot in the GPollFD
+ * array. Registrations thus survive GLib reordering its array of fds and the
+ * number of fds we can track isn't bound by the range of idents.
  *
- * We need to save the fds between invocations of g_android_poll() to keep
- * track of which fd has been removed from the list to remove them from the
- * ALooper.
+ * With G_ANDROID_POLL_BACKEND_CALLBACK, the fds are registered with a callback
+ * instead, given the registry entry as data. A single ALooper_pollOnce() runs
+ * the callbacks of all the fds ready at once, which write the revents straight
+ * into the GPollFD array, where ALooper_pollAll() returns one ident per call.
+ *
+ * GLib can give us the same fd several times, with different events, eg. for
+ * a socket with a source reading and another one writing. The fd is added to
+ * the looper once with the union of the events and its slots are chained in
+ * next_slots; when the fd is ready, each of its slots gets the revents it asked
+ * for.
+ *
+ * An fd closed and reopened with the same number between two iterations is
+ * silently dropped from the looper's epoll set while it stays in our registry,
+ * and GLib sorts its fds by number so the array can look exactly the same.
+ * Checking every fd at each iteration would cost a syscall per fd though, so
+ * the fds are only checked against the device and inode they had when added
+ * once a source was attached to the context since the last check, see
+ * sources_were_attached(). GLib signals the wakeup fd of the context, which
+ * it keeps in the array, whenever a poll record changes, which includes the
+ * sources it blocks while dispatching them: the poll reporting that fd ready
+ * has the next one look for new sources. The wakeup fd is told apart by
+ * waking the context up once, see find_wakeup_fd(); as long as it isn't
+ * known, any fd reported ready does. Only the fds pointing to a different
+ * file are added again. An fd reused with different events is added again
+ * anyway, the looper then adds it back to its epoll set, or we remove it
+ * first, see add_fd_to_looper(). An fd replaced by one with the same number
+ * and events in a source already attached isn't noticed.
  */
-static GPrivate tls_previous_fds = G_PRIVATE_INIT ((GDestroyNotify) g_array_unref);
+typedef struct _GAndroidFdRegistry GAndroidFdRegistry;
+
+typedef struct
+{
+  gint fd;
+  gint ident;           /* ident given to ALooper_addFd(), -1 if not added,
+                         * ALOOPER_POLL_CALLBACK when added with a callback */
+  gint events;          /* ALOOPER_EVENT_* flags given to ALooper_addFd() */
+  gint wanted;          /* union of the events of all the slots of the fd */
+  guint slot;           /* index of the first slot of the fd in the current
+                         * GPollFD array */
+  guint last_slot;      /* index of its last slot */
+  guint serial;         /* last g_android_poll() invocation the fd was seen */
+  guint signalled;      /* last invocation the fd was reported ready */
+  dev_t dev;            /* file the fd pointed to when added */
+  ino_t ino;
+  GAndroidFdRegistry *registry;
+} GAndroidFd;
+
+/* fd of android_native_app_glue removed from the looper, see
+ * GAndroidGlueSource */
+typedef struct
+{
+  struct android_app *app;
+  gint32 id;
+  gint fd;
+  void *data;
+  AInputQueue *queue;   /* queue the fd belongs to for LOOPER_ID_INPUT */
+} GAndroidMaskedGlue;
+
+#define NO_SLOT G_MAXUINT
+
+struct _GAndroidFdRegistry
+{
+  gint ref_count;       /* held by the thread polling the context and by its
+                         * looper source */
+  gpointer owner;       /* GAndroidPollState of that thread, NULL once it
+                         * has exited */
+
+  GHashTable *fds;      /* fd -> GAndroidFd */
+  GPtrArray *slots;     /* GAndroidFd of each slot of the array */
+  GArray *next_slots;   /* next slot with the same fd, NO_SLOT for the last */
+  guint serial;
+
+  /* the fds are registered with looper_fd_ready(), which needs the array
+   * being polled */
+  gboolean use_callbacks;
+  GPollFD *poll_fds;
+  gint n_new_ready;
+
+  /* fd of the GWakeup of the context, -1 until found, whether the fds may
+   * have been reused since the last poll and id of the last source attached
+   * when we looked */
+  gint wakeup_fd;
+  guint n_wakeup_probes;
+  gboolean check_reuse;
+  guint last_source_id;
+};
+
+typedef struct
+{
+  ALooper *looper;      /* looper of the thread, we hold a reference */
+
+  GHashTable *owners;   /* fd -> GAndroidFd added to the looper */
+  GSList *registries;   /* registries of the contexts polled by the thread */
+  GAndroidFdRegistry *registry;         /* registry polled last */
+  GAndroidFdRegistry *default_registry; /* for the polls without a looper
+                                         * source */
+  GArray *masked_glue;  /* GAndroidMaskedGlue */
+
+  /* whether the looper may still have responses queued, see drain_looper() */
+  gboolean queued;
+
+  /* GAndroidLooperSource of the context about to be polled, whether the
+   * background source of the context is ready and the timeout of the sources
+   * it doesn't hold back */
+  GSource *context_source;
+  gboolean background_ready;
+  gint background_timeout;
+
+  /* GAndroidLooperSource of the context dispatching after the last poll, we
+   * hold a reference */
+  GSource *dispatch_source;
+
+  /* statistics of the polls done without a looper source, when the context
+   * hasn't been prepared by GLib, and time the current poll was woken up */
+  GAndroidLoopStats loop_stats;
+  gint64 wake_time;
+} GAndroidPollState;
+
+static void
+g_android_fd_free (GAndroidFd *entry)
+{
+  g_slice_free (GAndroidFd, entry);
+}
+
+static void
+remove_fd_from_looper (ALooper *looper,
+                       gint     fd)
+{
+  gint res;
+
+  G_ANDROID_NOTE ("Remove fd %d", fd);
+
+  res = ALooper_removeFd (looper, fd);
+
+  if (G_UNLIKELY (res == 0))
+    {
+      g_warning ("We tried to remove the fd %d but it wasn't in "
+                 "the looper", fd);
+    }
+  else if (G_UNLIKELY (res == -1))
+    {
+      g_warning ("Could not remove fd %d from looper", fd);
+    }
+}
 
-static GArray *
-_get_previous_fds (void)
+static GAndroidFdRegistry *
+fd_registry_new (GAndroidPollState *state)
 {
-  return g_private_get (&tls_previous_fds);
+  GAndroidFdRegistry *registry;
+
+  registry = g_slice_new0 (GAndroidFdRegistry);
+  registry->ref_count = 1;
+  registry->owner = state;
+  registry->fds = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                         (GDestroyNotify) g_android_fd_free);
+  registry->slots = g_ptr_array_new ();
+  registry->next_slots = g_array_new (FALSE, FALSE, sizeof (guint));
+  registry->wakeup_fd = -1;
+
+  return registry;
 }
 
 static void
-_set_previous_fds (GArray *array)
+fd_registry_unref (GAndroidFdRegistry *registry)
 {
-  g_private_replace (&tls_previous_fds, array);
+  if (!g_atomic_int_dec_and_test (&registry->ref_count))
+    return;
+
+  g_hash_table_destroy (registry->fds);
+  g_ptr_array_free (registry->slots, TRUE);
+  g_array_free (registry->next_slots, TRUE);
+  g_slice_free (GAndroidFdRegistry, registry);
 }
 
+/*
+ * Removes the fds of a registry the thread won't poll any more from its
+ * looper and drops the reference of the thread
+ */
 static void
-save_poll_state (GPollFD *fds,
-                 gint    n_fds)
+drop_fd_registry (GAndroidPollState  *state,
+                  GAndroidFdRegistry *registry)
 {
-  GArray *previous_fds = _get_previous_fds ();
+  GHashTableIter iter;
+  GAndroidFd *entry;
+
+  g_atomic_pointer_set (&registry->owner, NULL);
 
-  if (G_UNLIKELY (previous_fds == NULL))
+  g_hash_table_iter_init (&iter, registry->fds);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
     {
-      previous_fds = g_array_sized_new (FALSE, FALSE, sizeof (GPollFD), n_fds);
-      _set_previous_fds (previous_fds);
+      if (entry->ident == -1)
+        continue;
+
+      remove_fd_from_looper (state->looper, entry->fd);
+      g_hash_table_remove (state->owners, GINT_TO_POINTER (entry->fd));
+      entry->ident = -1;
     }
 
-  g_array_set_size (previous_fds, 0);
-  g_array_insert_vals (previous_fds, 0, fds, n_fds);
+  if (state->registry == registry)
+    state->registry = NULL;
+
+  fd_registry_unref (registry);
 }
 
-static gboolean
-has_fd (GPollFD *fds,
-        guint    n_fds,
-        gint     fd)
+/*
+ * Drops the registries of the contexts that have been destroyed or are polled
+ * by another thread now, their looper source doesn't hold them any more
+ */
+static void
+prune_fd_registries (GAndroidPollState *state)
 {
-  guint i;
+  GSList *l, *next;
 
-  for (i = 0; i < n_fds; i++)
-    if (fds[i].fd == fd)
-      return TRUE;
+  for (l = state->registries; l; l = next)
+    {
+      GAndroidFdRegistry *registry = l->data;
 
-  return FALSE;
+      next = l->next;
+      if (g_atomic_int_get (&registry->ref_count) > 1)
+        continue;
+
+      drop_fd_registry (state, registry);
+      state->registries = g_slist_delete_link (state->registries, l);
+    }
+}
+
+static void
+poll_state_free (GAndroidPollState *state)
+{
+  if (state->dispatch_source)
+    g_source_unref (state->dispatch_source);
+
+  while (state->registries)
+    {
+      drop_fd_registry (state, state->registries->data);
+      state->registries = g_slist_delete_link (state->registries,
+                                               state->registries);
+    }
+  drop_fd_registry (state, state->default_registry);
+  g_hash_table_destroy (state->owners);
+  g_array_free (state->masked_glue, TRUE);
+  ALooper_release (state->looper);
+  g_slice_free (GAndroidPollState, state);
 }
 
+static GPrivate tls_poll_state = G_PRIVATE_INIT ((GDestroyNotify) poll_state_free);
+
 /*
- * Timer used when we need to re-enter the poll after handling LOOPER_ID_MAIN
- * and LOOPER_ID_INPUT events with an updated timeout value
+ * Returns the poll state of the calling thread, preparing a looper for the
+ * thread if it does not have one yet. Returns NULL if no looper could be
+ * prepared.
  */
-static GTimer *remaining_timeout;
+static GAndroidPollState *
+_get_poll_state (void)
+{
+  GAndroidPollState *state = g_private_get (&tls_poll_state);
+
+  if (G_UNLIKELY (state == NULL))
+    {
+      ALooper *looper;
+
+      /* We register fds with an ident, not a callback, the looper has to
+       * accept that. The one prepared by android_native_app_glue does */
+      looper = ALooper_prepare (ALOOPER_PREPARE_ALLOW_NON_CALLBACKS);
+      if (looper == NULL)
+        return NULL;
+
+      state = g_slice_new0 (GAndroidPollState);
+      state->looper = looper;
+      ALooper_acquire (looper);
+      state->owners = g_hash_table_new (g_direct_hash, g_direct_equal);
+      state->default_registry = fd_registry_new (state);
+      state->masked_glue = g_array_new (FALSE, FALSE,
+                                        sizeof (GAndroidMaskedGlue));
+      g_private_set (&tls_poll_state, state);
+    }
+
+  return state;
+}
 
 /*
- * Note: Having to do some bookkeeping ourselves to add/remove fds involves
- * O(n^2) operations, not great for a large number of fd...
- *
- * XXX: handle ALOOPER_EVENT_WAKE
+ * Adds the conditions of a ready fd to the revents of all its slots, each slot
+ * only getting the conditions it asked for. The looper can report an fd more
+ * than once in an invocation, the first time from a response queued by an
+ * earlier one, so the conditions are accumulated. Returns the number of slots
+ * newly signalled.
  */
 static gint
-g_android_poll (GPollFD *fds,
-                guint    n_fds,
-                gint     timeout_)
+signal_fd_slots (GAndroidFdRegistry *registry,
+                 GAndroidFd         *entry,
+                 gint                events)
 {
-  ALooper *looper;
-  gint res, out_fd, out_events;
+  GIOCondition condition;
+  GPollFD *poll_fd;
+  guint *next_slots;
   guint i;
-  void *out_data;
-  GArray *previous_fds;
+  gint n_signalled = 0;
+
+  condition = looper_event_to_g_io_condition (events);
+  next_slots = (guint *) registry->next_slots->data;
+  entry->signalled = registry->serial;
 
-  looper = ALooper_forThread ();
-  if (G_UNLIKELY (looper == NULL))
+  /* a poll record may have changed, see update_looper_fds() */
+  if (entry->fd == registry->wakeup_fd || registry->wakeup_fd == -1)
+    registry->check_reuse = TRUE;
+
+  for (i = entry->slot; i != NO_SLOT; i = next_slots[i])
     {
-      g_critical ("Could not retrieve the ALooper object");
-      return -1;
+      gushort revents;
+
+      poll_fd = &registry->poll_fds[i];
+      revents = condition & (poll_fd->events | G_IO_ERR | G_IO_HUP | G_IO_NVAL);
+      if (poll_fd->revents == 0 && revents != 0)
+        n_signalled++;
+      poll_fd->revents |= revents;
+    }
+
+  return n_signalled;
+}
+
+/*
+ * Callback of the fds registered in G_ANDROID_POLL_BACKEND_CALLBACK mode, run
+ * from ALooper_pollOnce() on the polling thread
+ */
+static int
+looper_fd_ready (int   fd,
+                 int   events,
+                 void *data)
+{
+  GAndroidPollState *state = g_private_get (&tls_poll_state);
+  GAndroidFd *entry = data;
+  GAndroidFdRegistry *registry = entry->registry;
+
+  if (G_UNLIKELY (state == NULL))
+    return 1;
+
+  /* fd of another context of the thread, see poll_looper(), returning 0
+   * removes it */
+  if (G_UNLIKELY (registry != state->registry))
+    {
+      G_ANDROID_NOTE ("Removing fd %d of another context", fd);
+      g_hash_table_remove (state->owners, GINT_TO_POINTER (fd));
+      entry->ident = -1;
+      return 0;
+    }
+
+  if (G_UNLIKELY (registry->poll_fds == NULL ||
+                  entry->serial != registry->serial))
+    {
+      G_ANDROID_NOTE ("Ignoring stale callback for fd %d", fd);
+      return 1;
+    }
+
+  registry->n_new_ready += signal_fd_slots (registry, entry, events);
+
+  return 1;
+}
+
+static gboolean
+add_fd_to_looper (GAndroidPollState *state,
+                  GAndroidFd        *entry,
+                  gint               events,
+                  gboolean           use_callbacks)
+{
+  ALooper *looper = state->looper;
+  ALooper_callbackFunc callback = NULL;
+  GAndroidFd *owner;
+  void *data = NULL;
+  gint ident = LOOPER_ID_USER;
+  struct stat st;
+  gint res;
+
+  G_ANDROID_NOTE ("Add fd %d", entry->fd);
+
+  if (use_callbacks)
+    {
+      ident = ALOOPER_POLL_CALLBACK;
+      callback = looper_fd_ready;
+      data = entry;
+    }
+
+  /* Re-adding a fd to the ALooper replaces it if previously added */
+  res = ALooper_addFd (looper, entry->fd, ident, events, callback, data);
+
+  /* Older loopers fail to replace an fd that has been closed and reused, it
+   * has to be removed first */
+  if (G_UNLIKELY (res == -1 && entry->ident != -1))
+    {
+      ALooper_removeFd (looper, entry->fd);
+      res = ALooper_addFd (looper, entry->fd, ident, events, callback, data);
+    }
+
+  if (G_UNLIKELY (res == -1))
+    {
+      g_warning ("Could not add fd %d to looper", entry->fd);
+      if (entry->ident != -1)
+        g_hash_table_remove (state->owners, GINT_TO_POINTER (entry->fd));
+      entry->ident = -1;
+      return FALSE;
+    }
+
+  /* The fd replaced the one of another context, which will have to add it
+   * again */
+  owner = g_hash_table_lookup (state->owners, GINT_TO_POINTER (entry->fd));
+  if (owner != NULL && owner != entry)
+    owner->ident = -1;
+  g_hash_table_insert (state->owners, GINT_TO_POINTER (entry->fd), entry);
+
+  entry->ident = ident;
+  entry->events = events;
+
+  if (fstat (entry->fd, &st) == 0)
+    {
+      entry->dev = st.st_dev;
+      entry->ino = st.st_ino;
     }
 
-  /* Re-adding a fd to the ALooper replaces it if previously added. It is safe
-   * to re-add all the fds we are given */
-  for (i = 0; i < n_fds; i ++)
+  return TRUE;
+}
+
+/* Whether the fd has been closed and its number reused since it was added */
+static gboolean
+fd_was_reused (GAndroidFd *entry)
+{
+  struct stat st;
+
+  if (fstat (entry->fd, &st) == -1)
+    return FALSE;
+
+  return st.st_dev != entry->dev || st.st_ino != entry->ino;
+}
+
+static GSourceFuncs probe_source_funcs = { NULL, NULL, NULL, NULL };
+
+/*
+ * Whether sources were attached to the context since the last call. GLib
+ * hands out source ids in order, so we attach a source of our own and
+ * compare its id with the one we got last time. That source has no poll
+ * record and is attached from the thread owning the context, GLib doesn't
+ * wake the context up for it.
+ */
+static gboolean
+sources_were_attached (GAndroidFdRegistry *registry,
+                       GMainContext       *context)
+{
+  GSource *probe;
+  guint id;
+  gboolean attached;
+
+  probe = g_source_new (&probe_source_funcs, sizeof (GSource));
+  id = g_source_attach (probe, context);
+  g_source_destroy (probe);
+  g_source_unref (probe);
+
+  attached = id != registry->last_source_id + 1;
+  registry->last_source_id = id;
+
+  return attached;
+}
+
+/*
+ * Diff the fds we are given against the registry and only tell the ALooper
+ * about the fds that have been added, removed, reused or that have changed.
+ * The fds are only checked for reuse when something changed, in the steady
+ * state this doesn't issue any syscall.
+ */
+static void
+update_looper_fds (GAndroidPollState  *state,
+                   GAndroidFdRegistry *registry,
+                   GMainContext       *context,
+                   GAndroidLoopStats  *stats,
+                   GPollFD            *fds,
+                   guint               n_fds,
+                   gboolean            use_callbacks)
+{
+  GHashTableIter iter;
+  GAndroidFd *entry;
+  gboolean switched, check_reuse;
+  guint *next_slots;
+  guint i, n_seen;
+
+  registry->serial++;
+
+  /* switching backend means registering all the fds again */
+  switched = use_callbacks != registry->use_callbacks;
+  registry->use_callbacks = use_callbacks;
+
+  check_reuse = registry->check_reuse &&
+                (context == NULL || sources_were_attached (registry, context));
+  registry->check_reuse = FALSE;
+
+  g_ptr_array_set_size (registry->slots, n_fds);
+  g_array_set_size (registry->next_slots, n_fds);
+  next_slots = (guint *) registry->next_slots->data;
+  n_seen = 0;
+
+  for (i = 0; i < n_fds; i++)
     {
-      int events;
+      entry = g_hash_table_lookup (registry->fds, GINT_TO_POINTER (fds[i].fd));
+      if (entry == NULL)
+        {
+          entry = g_slice_new0 (GAndroidFd);
+          entry->fd = fds[i].fd;
+          entry->ident = -1;
+          entry->registry = registry;
+          g_hash_table_insert (registry->fds, GINT_TO_POINTER (entry->fd),
+                               entry);
+        }
 
-      G_ANDROID_NOTE ("Add fd %d", fds[i].fd);
+      g_ptr_array_index (registry->slots, i) = entry;
+      next_slots[i] = NO_SLOT;
+      fds[i].revents = 0;
+
+      /* The same fd can appear several times in the array, chain its slots
+       * and merge their events */
+      if (entry->serial == registry->serial)
+        {
+          next_slots[entry->last_slot] = i;
+          entry->last_slot = i;
+          entry->wanted |= g_io_condition_to_looper_event (fds[i].events);
+          continue;
+        }
 
-      events = g_io_condition_to_looper_event (fds[i].events);
-      res = ALooper_addFd (looper, fds[i].fd, LOOPER_ID_USER + i, events,
-                           NULL, NULL);
-      if (G_UNLIKELY (res == -1))
-        g_warning ("Could not add fd %d to looper", fds[i].fd);
+      entry->slot = i;
+      entry->last_slot = i;
+      entry->wanted = g_io_condition_to_looper_event (fds[i].events);
+      entry->serial = registry->serial;
+      n_seen++;
     }
 
   /* Remove the fds that were in the previous call but are not present any
    * longer */
-  previous_fds = _get_previous_fds ();
-
-  if (G_LIKELY (previous_fds != NULL))
+  if (g_hash_table_size (registry->fds) != n_seen)
     {
-      for (i = 0; i < previous_fds->len; i++)
+      g_hash_table_iter_init (&iter, registry->fds);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
         {
-          GPollFD *fd = &g_array_index (previous_fds, GPollFD, i);
+          if (entry->serial == registry->serial)
+            continue;
 
-          if (!has_fd (fds, n_fds, fd->fd))
+          if (entry->ident != -1)
             {
-              G_ANDROID_NOTE ("Remove fd %d", fds[i].fd);
-
-              res = ALooper_removeFd (looper, fd->fd);
-
-              if (G_UNLIKELY (res == 0))
-                {
-                  g_warning ("We tried to remove the fd %d but it wasn't in "
-                             "the looper", fd->fd);
-                }
-              else if (G_UNLIKELY (res == -1))
-                {
-                  g_warning ("Could not remove fd %d from looper", fd->fd);
-                }
+              remove_fd_from_looper (state->looper, entry->fd);
+              g_hash_table_remove (state->owners, GINT_TO_POINTER (entry->fd));
+              stats->n_remove_fd++;
             }
+          g_hash_table_iter_remove (&iter);
         }
     }
 
-  /* It's time to poll now */
-poll:
-  G_ANDROID_NOTE ("Waiting in pollAll() for %dms", timeout_);
-  g_timer_start (remaining_timeout);
-  res = ALooper_pollAll (timeout_, &out_fd, &out_events, &out_data);
+  for (i = 0; i < n_fds; i++)
+    {
+      entry = g_ptr_array_index (registry->slots, i);
+      if (entry->slot != i)
+        continue;
 
-  /* save the fds we've been called with, we can return from the function
-   * pretty soon now */
-  save_poll_state (fds, n_fds);
+      if (!switched && entry->ident != -1 && entry->events == entry->wanted &&
+          !(check_reuse && fd_was_reused (entry)))
+        continue;
 
-  /* FIXME: let's assume that the underlying function behind ALooper_pollAll()
-   * sets errno */
-  if (res == ALOOPER_POLL_ERROR)
-    {
-      G_ANDROID_NOTE ("pollAll() returned an error (%d:%s)", errno,
-                      strerror (errno));
-      return -1;
+      add_fd_to_looper (state, entry, entry->wanted, use_callbacks);
+      stats->n_add_fd++;
     }
+}
 
-  /* A value of 0 indicates that the call timed out and no file descriptors
-   * were ready */
-  if (res == ALOOPER_POLL_TIMEOUT)
+/* Attempts at finding the wakeup fd of a context before giving up */
+#define WAKEUP_MAX_PROBES 3
+
+/*
+ * Finds the fd of the GWakeup of the context in the array GLib gives us: the
+ * one fd that becomes readable when waking the context up. Another fd
+ * becoming readable meanwhile, or the wakeup being already signalled, makes it
+ * ambiguous, we then try again at the next polls. This costs a couple of polls
+ * of the array, once.
+ */
+static void
+find_wakeup_fd (GAndroidFdRegistry *registry,
+                GMainContext       *context,
+                GPollFD            *fds,
+                guint               n_fds)
+{
+  gushort *revents;
+  gint wakeup_fd = -1;
+  guint i;
+
+  registry->n_wakeup_probes++;
+
+  revents = g_new (gushort, n_fds);
+  if (g_poll (fds, n_fds, 0) < 0)
+    goto out;
+
+  for (i = 0; i < n_fds; i++)
+    revents[i] = fds[i].revents;
+
+  g_main_context_wakeup (context);
+  if (g_poll (fds, n_fds, 0) < 0)
+    goto out;
+
+  for (i = 0; i < n_fds; i++)
     {
-      G_ANDROID_NOTE ("pollAll() timed out (%dms)", timeout_);
-      return 0;
+      if (!(fds[i].revents & G_IO_IN) || (revents[i] & G_IO_IN))
+        continue;
+
+      if (wakeup_fd != -1 && wakeup_fd != fds[i].fd)
+        {
+          wakeup_fd = -1;
+          break;
+        }
+
+      wakeup_fd = fds[i].fd;
     }
 
-  G_ANDROID_NOTE ("Processing id %s", looper_id_to_string (res));
+  G_ANDROID_NOTE ("Wakeup fd %d", wakeup_fd);
+  registry->wakeup_fd = wakeup_fd;
 
-  /* The glue provided in the NDK installs those two ids in the looper */
-  if (res == LOOPER_ID_MAIN || res == LOOPER_ID_INPUT)
+  /* acknowledge our wakeup, as g_wakeup_acknowledge() would, so the poll
+   * doesn't return right away */
+  if (wakeup_fd != -1)
     {
-      struct android_poll_source *source = out_data;
-      gdouble elapsed;
-      gint elapsed_ms;
+      gchar buffer[16];
 
-      if (source && source->process)
-        source->process (source->app, source);
+      while (read (wakeup_fd, buffer, sizeof (buffer)) == sizeof (buffer))
+        ;
+    }
 
-      if (timeout_ < 0)
-        goto poll;
+out:
+  g_free (revents);
+}
 
-      /* compute the new timeout, note this is done after processing the
-       * MAIN and INPUT source, so we effectively take into account the time
-       * we just spent in those process() functions */
-      elapsed = g_timer_elapsed (remaining_timeout, NULL);
-      elapsed_ms = elapsed * 1000;
+/*
+ * Marks a source pending. The poll returning is enough when the source is
+ * attached to the context being polled, otherwise its context is woken up.
+ */
+static void
+set_source_pending (GSource *source,
+                    gint    *pending)
+{
+  GMainContext *context;
 
-      timeout_ -= elapsed_ms;
-      if (timeout_ < 0)
-        return 0;
+  g_atomic_int_set (pending, TRUE);
 
-      goto poll;
+  context = g_source_get_context (source);
+  if (context && !g_main_context_is_owner (context))
+    g_main_context_wakeup (context);
+}
+
+/*
+ * Background policy. The activity state is tracked from the commands going
+ * through g_android_poll() or an app source. While the activity is paused or
+ * stopped, contexts poll with their background slack, and the contexts given
+ * a background priority with g_android_set_background_priority() don't
+ * dispatch their sources of lower priority.
+ *
+ * GLib neither prepares, polls nor dispatches the sources of lower priority
+ * than a ready one, so a background source with that priority is ready while
+ * paused. That makes GLib poll without a timeout though. The looper source
+ * keeps the background source last among the sources of its priority, so
+ * that the sources it doesn't hold back are all prepared before it: their
+ * timeout, which GLib has gathered so far, is what _g_android_poll() waits
+ * for instead.
+ */
+static gint activity_paused;
+
+G_LOCK_DEFINE_STATIC (background_sources);
+static GSList *background_sources;      /* to wake their context on resume */
+
+static gboolean
+background_source_prepare (GSource *source,
+                           gint    *timeout_)
+{
+  GAndroidPollState *state;
+  gint timeout;
+
+  *timeout_ = -1;
+
+  if (!g_atomic_int_get (&activity_paused))
+    return FALSE;
+
+  state = _get_poll_state ();
+  if (G_LIKELY (state))
+    {
+      /* GLib doesn't hold the context while preparing a source */
+      g_main_context_query (g_source_get_context (source), G_MAXINT, &timeout,
+                            NULL, 0);
+      state->background_ready = TRUE;
+      state->background_timeout = timeout;
     }
 
-  /* We've been signaled a fd, let's update GPollFD.revents. res is the ident
-   * we've given in addFd(), we can extract the index in fds from it */
-  i = res - LOOPER_ID_USER;
-  G_ANDROID_NOTE ("Signalling fd %d", fds[i].fd);
-  fds[i].revents = looper_event_to_g_io_condition (out_events);
-  ALooper_removeFd (looper, fds[i].fd);
+  return TRUE;
+}
 
-  return 1;
+static gboolean
+background_source_check (GSource *source)
+{
+  return g_atomic_int_get (&activity_paused);
 }
 
-gboolean
-g_android_init (void)
+static gboolean
+background_source_dispatch (GSource     *source,
+                            GSourceFunc  callback,
+                            gpointer     user_data)
 {
-  GMainContext *context;
+  return TRUE;
+}
 
-  /* logs */
-  g_log_set_default_handler (g_android_log_handler, NULL);
+static void
+background_source_finalize (GSource *source)
+{
+  G_LOCK (background_sources);
+  background_sources = g_slist_remove (background_sources, source);
+  G_UNLOCK (background_sources);
+}
 
-  /* main loop */
-  remaining_timeout = g_timer_new ();
+static GSourceFuncs background_source_funcs =
+{
+  background_source_prepare,
+  background_source_check,
+  background_source_dispatch,
+  background_source_finalize
+};
 
-  context = g_main_context_default ();
-  g_main_context_set_poll_func (context, g_android_poll);
+static void
+update_activity_state (struct android_app *app)
+{
+  GSList *l;
+  gboolean paused;
+
+  paused = app->activityState == APP_CMD_PAUSE ||
+           app->activityState == APP_CMD_STOP;
+  if (paused == g_atomic_int_get (&activity_paused))
+    return;
+
+  G_ANDROID_NOTE ("Activity %s", paused ? "paused" : "resumed");
+
+  g_atomic_int_set (&activity_paused, paused);
+  if (paused)
+    return;
+
+  /* Don't wait for the next background tick of the contexts holding
+   * sources back */
+  G_LOCK (background_sources);
+  for (l = background_sources; l; l = l->next)
+    if (!g_source_is_destroyed (l->data))
+      g_main_context_wakeup (g_source_get_context (l->data));
+  G_UNLOCK (background_sources);
+}
 
-  return TRUE;
+/*
+ * GSources dispatching the commands and input events of
+ * android_native_app_glue. When the looper reports LOOPER_ID_MAIN or
+ * LOOPER_ID_INPUT for an app that has such a source, g_android_poll() only
+ * marks the source pending and GLib dispatches it according to its priority.
+ * The sources are kept in a global list as they may be attached to a context
+ * run by another thread than the one polling the app's looper.
+ *
+ * The fd of the glue stays ready until the source reads from it. When the
+ * source isn't attached to the context being polled, the polling thread would
+ * be woken up by that fd over and over until the source gets dispatched by its
+ * own context, so the fd is masked: removed from the looper until the source
+ * has read from it, the source then wakes the looper up to have it added
+ * back.
+ */
+typedef struct
+{
+  GSource source;
+
+  struct android_app *app;
+  gint32 id;            /* LOOPER_ID_MAIN or LOOPER_ID_INPUT */
+  gint pending;
+  gint masked;          /* the fd of id is masked until the next dispatch */
+} GAndroidGlueSource;
+
+#define GLUE_SOURCE_HERE        (1 << 0)
+#define GLUE_SOURCE_ELSEWHERE   (1 << 1)
+
+G_LOCK_DEFINE_STATIC (glue_sources);
+static GList *glue_sources;
+
+/*
+ * Marks pending the sources taking care of the events of @id for @app, if
+ * any. Returns GLUE_SOURCE_HERE if one of them is attached to @context, the
+ * context being polled, GLUE_SOURCE_ELSEWHERE if one of them is attached to
+ * another context, which will unmask the fd
+ */
+static guint
+glue_source_set_pending (struct android_app *app,
+                         gint32              id,
+                         GMainContext       *context)
+{
+  GAndroidGlueSource *glue_source;
+  guint found = 0;
+  GList *l;
+
+  G_LOCK (glue_sources);
+
+  for (l = glue_sources; l; l = l->next)
+    {
+      glue_source = l->data;
+      if (glue_source->app != app || glue_source->id != id ||
+          g_source_is_destroyed ((GSource *) glue_source))
+        continue;
+
+      /* Finalizing the source takes the lock, the source and its context
+       * stay alive while we hold it */
+      if (g_source_get_context ((GSource *) glue_source) == context)
+        {
+          found |= GLUE_SOURCE_HERE;
+        }
+      else
+        {
+          found |= GLUE_SOURCE_ELSEWHERE;
+          g_atomic_int_set (&glue_source->masked, TRUE);
+        }
+      set_source_pending ((GSource *) glue_source, &glue_source->pending);
+    }
+
+  G_UNLOCK (glue_sources);
+
+  return found;
+}
+
+/* Whether a source still has the fd of @id for @app masked */
+static gboolean
+glue_source_is_masked (struct android_app *app,
+                       gint32              id)
+{
+  GAndroidGlueSource *glue_source;
+  gboolean masked = FALSE;
+  GList *l;
+
+  G_LOCK (glue_sources);
+
+  for (l = glue_sources; l && !masked; l = l->next)
+    {
+      glue_source = l->data;
+      masked = glue_source->app == app && glue_source->id == id &&
+               g_atomic_int_get (&glue_source->masked);
+    }
+
+  G_UNLOCK (glue_sources);
+
+  return masked;
+}
+
+/*
+ * Called once the source has read from the fd of the glue, the thread polling
+ * the looper of the app adds the fd back if it was masked
+ */
+static void
+glue_source_unmask (GAndroidGlueSource *glue_source)
+{
+  if (g_atomic_int_get (&glue_source->masked))
+    {
+      g_atomic_int_set (&glue_source->masked, FALSE);
+      ALooper_wake (glue_source->app->looper);
+    }
+}
+
+static gboolean
+glue_source_prepare (GSource *source,
+                     gint    *timeout_)
+{
+  GAndroidGlueSource *glue_source = (GAndroidGlueSource *) source;
+
+  *timeout_ = -1;
+
+  return g_atomic_int_get (&glue_source->pending);
+}
+
+static gboolean
+glue_source_check (GSource *source)
+{
+  GAndroidGlueSource *glue_source = (GAndroidGlueSource *) source;
+
+  return g_atomic_int_get (&glue_source->pending);
+}
+
+static gboolean
+app_source_dispatch (GSource     *source,
+                     GSourceFunc  callback,
+                     gpointer     user_data)
+{
+  GAndroidGlueSource *glue_source = (GAndroidGlueSource *) source;
+  GAndroidAppFunc func = (GAndroidAppFunc) (void (*) (void)) callback;
+  struct android_app *app = glue_source->app;
+  int8_t cmd;
+
+  /* if more commands are queued, the next poll marks us pending again */
+  g_atomic_int_set (&glue_source->pending, FALSE);
+
+  cmd = android_app_read_cmd (app);
+  glue_source_unmask (glue_source);
+  if (cmd < 0)
+    return TRUE;
+
+  android_app_pre_exec_cmd (app, cmd);
+  if (func)
+    func (app, cmd, user_data);
+  android_app_post_exec_cmd (app, cmd);
+
+  update_activity_state (app);
+
+  return TRUE;
+}
+
+static gboolean
+input_source_dispatch (GSource     *source,
+                       GSourceFunc  callback,
+                       gpointer     user_data)
+{
+  GAndroidGlueSource *glue_source = (GAndroidGlueSource *) source;
+  GAndroidInputFunc func = (GAndroidInputFunc) (void (*) (void)) callback;
+  struct android_app *app = glue_source->app;
+  AInputEvent *event = NULL;
+  gboolean has_event, handled = FALSE;
+
+  g_atomic_int_set (&glue_source->pending, FALSE);
+
+  has_event = app->inputQueue != NULL &&
+              AInputQueue_getEvent (app->inputQueue, &event) >= 0;
+  glue_source_unmask (glue_source);
+  if (!has_event)
+    return TRUE;
+
+  if (AInputQueue_preDispatchEvent (app->inputQueue, event))
+    return TRUE;
+
+  if (func)
+    handled = func (app, event, user_data);
+  AInputQueue_finishEvent (app->inputQueue, event, handled);
+
+  return TRUE;
+}
+
+/*
+ * The batch input source drains up to G_ANDROID_INPUT_BATCH_MAX events per
+ * dispatch into arrays kept in the source, so a dispatch doesn't allocate.
+ */
+typedef struct
+{
+  GAndroidGlueSource glue_source;
+
+  GAndroidInputBatchFlags flags;
+  AInputEvent *events[G_ANDROID_INPUT_BATCH_MAX];
+  gboolean handled[G_ANDROID_INPUT_BATCH_MAX];
+} GAndroidInputBatchSource;
+
+/* Whether @event only updates the position of the pointers of @previous */
+static gboolean
+can_coalesce_motion (const AInputEvent *previous,
+                     const AInputEvent *event)
+{
+  size_t i, n_pointers;
+
+  if (AInputEvent_getType (previous) != AINPUT_EVENT_TYPE_MOTION ||
+      AInputEvent_getType (event) != AINPUT_EVENT_TYPE_MOTION)
+    return FALSE;
+
+  if ((AMotionEvent_getAction (previous) & AMOTION_EVENT_ACTION_MASK) !=
+      AMOTION_EVENT_ACTION_MOVE ||
+      (AMotionEvent_getAction (event) & AMOTION_EVENT_ACTION_MASK) !=
+      AMOTION_EVENT_ACTION_MOVE)
+    return FALSE;
+
+  if (AInputEvent_getDeviceId (previous) != AInputEvent_getDeviceId (event) ||
+      AInputEvent_getSource (previous) != AInputEvent_getSource (event))
+    return FALSE;
+
+  n_pointers = AMotionEvent_getPointerCount (event);
+  if (AMotionEvent_getPointerCount (previous) != n_pointers)
+    return FALSE;
+
+  for (i = 0; i < n_pointers; i++)
+    if (AMotionEvent_getPointerId (previous, i) !=
+        AMotionEvent_getPointerId (event, i))
+      return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+input_batch_source_dispatch (GSource     *source,
+                             GSourceFunc  callback,
+                             gpointer     user_data)
+{
+  GAndroidInputBatchSource *batch_source = (GAndroidInputBatchSource *) source;
+  GAndroidGlueSource *glue_source = (GAndroidGlueSource *) source;
+  GAndroidInputBatchFunc func;
+  struct android_app *app = glue_source->app;
+  AInputQueue *queue = app->inputQueue;
+  AInputEvent *event;
+  guint i, n_events;
+
+  func = (GAndroidInputBatchFunc) (void (*) (void)) callback;
+
+  g_atomic_int_set (&glue_source->pending, FALSE);
+
+  n_events = 0;
+  while (queue != NULL && n_events < G_ANDROID_INPUT_BATCH_MAX &&
+         AInputQueue_getEvent (queue, &event) >= 0)
+    {
+      if (AInputQueue_preDispatchEvent (queue, event))
+        continue;
+
+      /* the latest position of the pointers replaces the previous one */
+      if (batch_source->flags & G_ANDROID_INPUT_BATCH_COALESCE_MOTION &&
+          n_events > 0 &&
+          can_coalesce_motion (batch_source->events[n_events - 1], event))
+        {
+          AInputQueue_finishEvent (queue, batch_source->events[n_events - 1],
+                                   TRUE);
+          batch_source->events[n_events - 1] = event;
+          continue;
+        }
+
+      batch_source->events[n_events] = event;
+      batch_source->handled[n_events] = FALSE;
+      n_events++;
+    }
+  glue_source_unmask (glue_source);
+
+  if (n_events == 0)
+    return TRUE;
+
+  if (func)
+    func (app, batch_source->events, batch_source->handled, n_events,
+          user_data);
+
+  for (i = 0; i < n_events; i++)
+    AInputQueue_finishEvent (queue, batch_source->events[i],
+                             batch_source->handled[i]);
+
+  return TRUE;
+}
+
+static void
+glue_source_finalize (GSource *source)
+{
+  G_LOCK (glue_sources);
+  glue_sources = g_list_remove (glue_sources, source);
+  G_UNLOCK (glue_sources);
+
+  glue_source_unmask ((GAndroidGlueSource *) source);
+}
+
+static GSourceFuncs app_source_funcs =
+{
+  glue_source_prepare,
+  glue_source_check,
+  app_source_dispatch,
+  glue_source_finalize
+};
+
+static GSourceFuncs input_source_funcs =
+{
+  glue_source_prepare,
+  glue_source_check,
+  input_source_dispatch,
+  glue_source_finalize
+};
+
+static GSourceFuncs input_batch_source_funcs =
+{
+  glue_source_prepare,
+  glue_source_check,
+  input_batch_source_dispatch,
+  glue_source_finalize
+};
+
+static GSource *
+glue_source_new (GSourceFuncs       *funcs,
+                 guint               struct_size,
+                 struct android_app *app,
+                 gint32              id)
+{
+  GAndroidGlueSource *glue_source;
+  GSource *source;
+
+  source = g_source_new (funcs, struct_size);
+  glue_source = (GAndroidGlueSource *) source;
+  glue_source->app = app;
+  glue_source->id = id;
+
+  G_LOCK (glue_sources);
+  glue_sources = g_list_prepend (glue_sources, glue_source);
+  G_UNLOCK (glue_sources);
+
+  return source;
+}
+
+/*
+ * Sensor sources read the events of their ASensorEventQueue in bulk into a
+ * buffer allocated once. Events can be held in the buffer for up to the
+ * latency of the source before being dispatched, so a high rate sensor
+ * doesn't wake the callback up for every event.
+ */
+typedef struct
+{
+  GSource source;
+  gint pending;         /* the queue fd is ready, see LOOPER_ID_SOURCE */
+
+  ASensorManager *manager;
+  ASensorEventQueue *queue;
+
+  ASensorEvent *events;
+  guint n_events;
+  guint max_events;
+
+  gint64 latency;       /* us */
+  gint64 first_event_time;
+} GAndroidSensorSource;
+
+/*
+ * The looper can still have a response queued for the fd of a sensor source
+ * that has been finalized since, with the source as data. Only the sources in
+ * sensor_sources are marked pending.
+ */
+G_LOCK_DEFINE_STATIC (sensor_sources);
+static GHashTable *sensor_sources;
+
+static void
+sensor_source_set_pending (gpointer data)
+{
+  GAndroidSensorSource *sensor_source = data;
+
+  G_LOCK (sensor_sources);
+
+  if (sensor_sources && g_hash_table_lookup (sensor_sources, data) &&
+      !g_source_is_destroyed (data))
+    set_source_pending (data, &sensor_source->pending);
+  else
+    G_ANDROID_NOTE ("Ignoring stale event for sensor source %p", data);
+
+  G_UNLOCK (sensor_sources);
+}
+
+/* Time until the buffered events have to be dispatched, -1 if none */
+static gint64
+sensor_source_get_remaining (GAndroidSensorSource *sensor_source)
+{
+  gint64 remaining;
+
+  if (sensor_source->n_events == 0)
+    return -1;
+
+  remaining = sensor_source->first_event_time + sensor_source->latency -
+              g_source_get_time ((GSource *) sensor_source);
+
+  return MAX (remaining, 0);
+}
+
+static gboolean
+sensor_source_prepare (GSource *source,
+                       gint    *timeout_)
+{
+  GAndroidSensorSource *sensor_source = (GAndroidSensorSource *) source;
+  gint64 remaining;
+
+  *timeout_ = -1;
+
+  if (g_atomic_int_get (&sensor_source->pending))
+    return TRUE;
+
+  remaining = sensor_source_get_remaining (sensor_source);
+  if (remaining < 0)
+    return FALSE;
+
+  *timeout_ = (remaining + 999) / 1000;
+
+  return remaining == 0;
+}
+
+static gboolean
+sensor_source_check (GSource *source)
+{
+  GAndroidSensorSource *sensor_source = (GAndroidSensorSource *) source;
+
+  if (g_atomic_int_get (&sensor_source->pending))
+    return TRUE;
+
+  return sensor_source_get_remaining (sensor_source) == 0;
+}
+
+static gboolean
+sensor_source_dispatch (GSource     *source,
+                        GSourceFunc  callback,
+                        gpointer     user_data)
+{
+  GAndroidSensorSource *sensor_source = (GAndroidSensorSource *) source;
+  GAndroidSensorFunc func;
+  guint n_events;
+  ssize_t res;
+
+  func = (GAndroidSensorFunc) (void (*) (void)) callback;
+
+  /* if the buffer fills up before the queue is empty, the next poll marks us
+   * pending again */
+  g_atomic_int_set (&sensor_source->pending, FALSE);
+
+  while (sensor_source->n_events < sensor_source->max_events)
+    {
+      res = ASensorEventQueue_getEvents (sensor_source->queue,
+                                         sensor_source->events +
+                                         sensor_source->n_events,
+                                         sensor_source->max_events -
+                                         sensor_source->n_events);
+      if (res <= 0)
+        break;
+
+      if (sensor_source->n_events == 0)
+        sensor_source->first_event_time = g_source_get_time (source);
+      sensor_source->n_events += res;
+    }
+
+  /* hold the events until the buffer is full or the latency is reached */
+  if (sensor_source->n_events == 0 ||
+      (sensor_source->n_events < sensor_source->max_events &&
+       sensor_source_get_remaining (sensor_source) > 0))
+    return TRUE;
+
+  n_events = sensor_source->n_events;
+  sensor_source->n_events = 0;
+
+  if (func == NULL)
+    return TRUE;
+
+  return func (sensor_source->events, n_events, user_data);
+}
+
+static void
+sensor_source_finalize (GSource *source)
+{
+  GAndroidSensorSource *sensor_source = (GAndroidSensorSource *) source;
+
+  G_LOCK (sensor_sources);
+  g_hash_table_remove (sensor_sources, source);
+  G_UNLOCK (sensor_sources);
+
+  ASensorManager_destroyEventQueue (sensor_source->manager,
+                                    sensor_source->queue);
+  g_free (sensor_source->events);
+}
+
+static GSourceFuncs sensor_source_funcs =
+{
+  sensor_source_prepare,
+  sensor_source_check,
+  sensor_source_dispatch,
+  sensor_source_finalize
+};
+
+/*
+ * Frame sources tick on a grid of period interval, based on the monotonic
+ * clock, instead of rearming a timeout after each frame: ticks don't drift,
+ * and a frame overrunning its interval has the next tick land on the next
+ * grid point, the frames missed in between being skipped instead of queued.
+ * A periodic timerfd wakes the loop up on the grid when available, otherwise
+ * the ready time of the source is set to the next tick. The timer is disarmed
+ * while the activity is paused.
+ */
+typedef struct
+{
+  GSource source;
+
+  GPollFD poll_fd;      /* timerfd, -1 when using the ready time */
+  gboolean armed;
+
+  gint64 interval;      /* us */
+  gint64 last_frame;    /* index of the last frame on the grid */
+} GAndroidFrameSource;
+
+static void
+frame_source_arm (GAndroidFrameSource *frame_source)
+{
+  gint64 next_frame_time;
+
+  /* frames missed while disarmed aren't skipped, they were never due */
+  frame_source->last_frame = g_get_monotonic_time () / frame_source->interval;
+  next_frame_time = (frame_source->last_frame + 1) * frame_source->interval;
+  frame_source->armed = TRUE;
+
+#ifdef HAVE_SYS_TIMERFD_H
+  if (frame_source->poll_fd.fd != -1)
+    {
+      struct itimerspec spec;
+
+      spec.it_value.tv_sec = next_frame_time / G_USEC_PER_SEC;
+      spec.it_value.tv_nsec = next_frame_time % G_USEC_PER_SEC * 1000;
+      spec.it_interval.tv_sec = frame_source->interval / G_USEC_PER_SEC;
+      spec.it_interval.tv_nsec = frame_source->interval % G_USEC_PER_SEC * 1000;
+
+      if (timerfd_settime (frame_source->poll_fd.fd, TFD_TIMER_ABSTIME, &spec,
+                           NULL) == 0)
+        return;
+
+      g_warning ("Could not arm the frame timer: %s", g_strerror (errno));
+    }
+#endif
+
+  g_source_set_ready_time ((GSource *) frame_source, next_frame_time);
+}
+
+static void
+frame_source_disarm (GAndroidFrameSource *frame_source)
+{
+  frame_source->armed = FALSE;
+
+#ifdef HAVE_SYS_TIMERFD_H
+  if (frame_source->poll_fd.fd != -1)
+    {
+      struct itimerspec spec;
+
+      memset (&spec, 0, sizeof (spec));
+      timerfd_settime (frame_source->poll_fd.fd, 0, &spec, NULL);
+      return;
+    }
+#endif
+
+  g_source_set_ready_time ((GSource *) frame_source, -1);
+}
+
+static gboolean
+frame_source_prepare (GSource *source,
+                      gint    *timeout_)
+{
+  GAndroidFrameSource *frame_source = (GAndroidFrameSource *) source;
+  gboolean paused;
+
+  *timeout_ = -1;
+
+  paused = g_atomic_int_get (&activity_paused);
+  if (paused && frame_source->armed)
+    frame_source_disarm (frame_source);
+  else if (!paused && !frame_source->armed)
+    frame_source_arm (frame_source);
+
+  return FALSE;
+}
+
+static gboolean
+frame_source_check (GSource *source)
+{
+  GAndroidFrameSource *frame_source = (GAndroidFrameSource *) source;
+
+  return frame_source->poll_fd.revents & G_IO_IN;
+}
+
+static gboolean
+frame_source_dispatch (GSource     *source,
+                       GSourceFunc  callback,
+                       gpointer     user_data)
+{
+  GAndroidFrameSource *frame_source = (GAndroidFrameSource *) source;
+  GAndroidFrameFunc func = (GAndroidFrameFunc) (void (*) (void)) callback;
+  gint64 frame, frame_time;
+  guint n_skipped;
+
+  if (frame_source->poll_fd.fd != -1)
+    {
+      guint64 n_expirations;
+
+      /* the frame index is derived from the clock, not from this count */
+      if (read (frame_source->poll_fd.fd, &n_expirations,
+                sizeof (n_expirations)) < 0 && errno == EAGAIN)
+        return TRUE;
+    }
+
+  /* the next prepare() disarms the timer */
+  if (!frame_source->armed || g_atomic_int_get (&activity_paused))
+    return TRUE;
+
+  frame = g_get_monotonic_time () / frame_source->interval;
+  if (G_UNLIKELY (frame <= frame_source->last_frame))
+    frame = frame_source->last_frame + 1;
+
+  n_skipped = frame - frame_source->last_frame - 1;
+  frame_source->last_frame = frame;
+  frame_time = frame * frame_source->interval;
+
+  if (frame_source->poll_fd.fd == -1)
+    g_source_set_ready_time (source, frame_time + frame_source->interval);
+
+  if (func == NULL)
+    return TRUE;
+
+  return func (frame_time, frame_time + frame_source->interval, n_skipped,
+               user_data);
+}
+
+static void
+frame_source_finalize (GSource *source)
+{
+  GAndroidFrameSource *frame_source = (GAndroidFrameSource *) source;
+
+  if (frame_source->poll_fd.fd != -1)
+    close (frame_source->poll_fd.fd);
+}
+
+static GSourceFuncs frame_source_funcs =
+{
+  frame_source_prepare,
+  frame_source_check,
+  frame_source_dispatch,
+  frame_source_finalize
+};
+
+/*
+ * An attached context carries a GAndroidLooperSource holding the looper of the
+ * thread that attached it, for g_android_context_wakeup() to find it. The
+ * source never dispatches and releases the looper when the context goes
+ * away.
+ *
+ * It also carries the timer slack policy of the context. GPollFunc doesn't
+ * tell us which context is being polled, so the source, which has the highest
+ * priority and is thus always prepared, tells the poll state of the thread
+ * right before GLib polls.
+ */
+typedef struct
+{
+  GSource source;
+
+  ALooper *looper;
+
+  guint slack;                          /* ms, 0 if disabled */
+  guint background_slack;               /* ms, used while paused if wider */
+  GSource *background_source;           /* NULL without background priority */
+  GAndroidTimerSlackStats slack_stats;
+
+  GAndroidLoopStats loop_stats;
+
+  GAndroidFdRegistry *registry;         /* created by the polling thread */
+
+  /* dispatch profiler, see below */
+  gboolean profiling;
+  gint64 dispatch_start;                /* end of the last poll, 0 if none */
+  guint64 profiled_time;                /* of the profiled sources since */
+  GAndroidDispatchProfile profiles[G_ANDROID_N_DISPATCH_PROFILES];
+  guint n_profiles;
+  GAndroidSlowDispatch slowest[G_ANDROID_N_SLOWEST_DISPATCHES];
+  guint n_slowest;
+} GAndroidLooperSource;
+
+/*
+ * Dispatch profiler. The thread polling a context with profiling enabled
+ * times its dispatches from the end of the poll to the next prepare of the
+ * looper source, and accounts them to the profiles of the context without
+ * any locking, as for the loop statistics.
+ *
+ * The sources set profiled with g_android_source_set_profiled() have their
+ * callback wrapped to time their own dispatches. Those are accounted to the
+ * name of the source, or to its type for unnamed GLib sources, so the numbers
+ * outlive the sources. The rest of each dispatch phase is accounted to the
+ * unprofiled sources, which finds the slow sources nobody thought of setting
+ * profiled. The slowest dispatches are kept aside, slowest first, to tell
+ * what made a frame late.
+ */
+static const gchar unprofiled_sources[] = "Unprofiled sources";
+
+static GAndroidDispatchProfile *
+get_dispatch_profile (GAndroidLooperSource *looper_source,
+                      const gchar          *name)
+{
+  GAndroidDispatchProfile *profile;
+  guint i;
+
+  for (i = 0; i < looper_source->n_profiles; i++)
+    if (looper_source->profiles[i].name == name)
+      return &looper_source->profiles[i];
+
+  /* the last profile is kept for the unprofiled sources */
+  if (looper_source->n_profiles == G_ANDROID_N_DISPATCH_PROFILES - 1 &&
+      name != unprofiled_sources)
+    return get_dispatch_profile (looper_source, unprofiled_sources);
+
+  profile = &looper_source->profiles[looper_source->n_profiles++];
+  memset (profile, 0, sizeof (GAndroidDispatchProfile));
+  profile->name = name;
+
+  return profile;
+}
+
+static void
+record_dispatch (GAndroidLooperSource *looper_source,
+                 const gchar          *name,
+                 gint64                start,
+                 guint64               duration)
+{
+  GAndroidDispatchProfile *profile;
+  GAndroidSlowDispatch *slowest = looper_source->slowest;
+  guint i, n_slowest = looper_source->n_slowest;
+
+  profile = get_dispatch_profile (looper_source, name);
+  profile->n_dispatches++;
+  profile->total_time += duration;
+  profile->max_time = MAX (profile->max_time, duration);
+
+  if (n_slowest == G_ANDROID_N_SLOWEST_DISPATCHES &&
+      duration <= slowest[n_slowest - 1].duration)
+    return;
+
+  i = MIN (n_slowest, G_ANDROID_N_SLOWEST_DISPATCHES - 1);
+  while (i > 0 && slowest[i - 1].duration < duration)
+    {
+      slowest[i] = slowest[i - 1];
+      i--;
+    }
+
+  slowest[i].name = profile->name;
+  slowest[i].time = start;
+  slowest[i].duration = duration;
+
+  if (n_slowest < G_ANDROID_N_SLOWEST_DISPATCHES)
+    looper_source->n_slowest++;
+}
+
+/* Accounts what the profiled sources didn't take of the last dispatch phase */
+static void
+end_dispatch_phase (GAndroidLooperSource *looper_source)
+{
+  gint64 duration;
+
+  duration = g_get_monotonic_time () - looper_source->dispatch_start;
+  if (duration > (gint64) looper_source->profiled_time)
+    record_dispatch (looper_source, unprofiled_sources,
+                     looper_source->dispatch_start,
+                     duration - looper_source->profiled_time);
+
+  looper_source->dispatch_start = 0;
+  looper_source->profiled_time = 0;
+}
+
+/*
+ * Callback of a source set profiled, wrapping its original one. GLib gets the
+ * callback right before each dispatch and drops the reference it took right
+ * after.
+ */
+typedef struct
+{
+  gint ref_count;
+
+  GSourceCallbackFuncs *funcs;          /* the original callback, if any */
+  gpointer data;
+
+  const gchar *name;                    /* set on the first dispatch */
+  GAndroidLooperSource *looper_source;  /* while dispatching */
+  gint64 start;
+} GAndroidProfiledCallback;
+
+static const gchar *
+get_profile_name (GSource *source)
+{
+  const gchar *name;
+
+  name = g_source_get_name (source);
+  if (name)
+    return g_intern_string (name);
+
+  if (source->source_funcs == &g_timeout_funcs)
+    return g_intern_static_string ("GTimeoutSource");
+
+  if (source->source_funcs == &g_idle_funcs)
+    return g_intern_static_string ("GIdleSource");
+
+  if (source->source_funcs == &g_io_watch_funcs)
+    return g_intern_static_string ("GIOWatch");
+
+  if (source->source_funcs == &g_child_watch_funcs)
+    return g_intern_static_string ("GChildWatchSource");
+
+  return g_intern_static_string ("Unnamed source");
+}
+
+static void
+profiled_callback_ref (gpointer cb_data)
+{
+  GAndroidProfiledCallback *callback = cb_data;
+
+  g_atomic_int_inc (&callback->ref_count);
+}
+
+static void
+profiled_callback_unref (gpointer cb_data)
+{
+  GAndroidProfiledCallback *callback = cb_data;
+  GAndroidLooperSource *looper_source = callback->looper_source;
+  guint64 duration;
+
+  if (looper_source)
+    {
+      duration = g_get_monotonic_time () - callback->start;
+      record_dispatch (looper_source, callback->name, callback->start,
+                       duration);
+      looper_source->profiled_time += duration;
+      callback->looper_source = NULL;
+    }
+
+  if (!g_atomic_int_dec_and_test (&callback->ref_count))
+    return;
+
+  if (callback->funcs)
+    callback->funcs->unref (callback->data);
+  g_slice_free (GAndroidProfiledCallback, callback);
+}
+
+/* Called with the lock of the context held */
+static void
+profiled_callback_get (gpointer     cb_data,
+                       GSource     *source,
+                       GSourceFunc *func,
+                       gpointer    *data)
+{
+  GAndroidProfiledCallback *callback = cb_data;
+  GAndroidLooperSource *looper_source = NULL;
+  GAndroidPollState *state;
+
+  if (callback->funcs)
+    {
+      callback->funcs->get (callback->data, source, func, data);
+    }
+  else
+    {
+      *func = NULL;
+      *data = NULL;
+    }
+
+  /* a nested iteration may have polled another context since */
+  state = g_private_get (&tls_poll_state);
+  if (state)
+    looper_source = (GAndroidLooperSource *) state->dispatch_source;
+  if (looper_source == NULL || !looper_source->profiling ||
+      looper_source->dispatch_start == 0 ||
+      g_source_is_destroyed ((GSource *) looper_source) ||
+      g_source_get_context (source) !=
+      g_source_get_context ((GSource *) looper_source))
+    return;
+
+  if (G_UNLIKELY (callback->name == NULL))
+    callback->name = get_profile_name (source);
+
+  callback->looper_source = looper_source;
+  callback->start = g_get_monotonic_time ();
+}
+
+static GSourceCallbackFuncs profiled_callback_funcs =
+{
+  profiled_callback_ref,
+  profiled_callback_unref,
+  profiled_callback_get
+};
+
+static gboolean
+looper_source_prepare (GSource *source,
+                       gint    *timeout_)
+{
+  GAndroidLooperSource *looper_source = (GAndroidLooperSource *) source;
+  GAndroidPollState *state = _get_poll_state ();
+  GSource *background;
+
+  if (G_LIKELY (state))
+    {
+      state->context_source = source;
+      state->background_ready = FALSE;
+    }
+
+  /* Setting the priority again moves the background source after the
+   * sources attached since with the same priority, see the background
+   * policy */
+  background = looper_source->background_source;
+  if (background && background->next && g_atomic_int_get (&activity_paused))
+    g_source_set_priority (background, g_source_get_priority (background));
+
+  if (looper_source->dispatch_start > 0)
+    end_dispatch_phase (looper_source);
+
+  *timeout_ = -1;
+
+  return FALSE;
+}
+
+static gboolean
+looper_source_check (GSource *source)
+{
+  return FALSE;
+}
+
+static gboolean
+looper_source_dispatch (GSource     *source,
+                        GSourceFunc  callback,
+                        gpointer     user_data)
+{
+  return TRUE;
+}
+
+/*
+ * Protects the looper of the looper sources against their finalization and
+ * the reattachment of their context from another thread, for the callers
+ * that don't run the context, see g_android_context_wakeup()
+ */
+G_LOCK_DEFINE_STATIC (looper_sources);
+
+static void
+looper_source_finalize (GSource *source)
+{
+  GAndroidLooperSource *looper_source = (GAndroidLooperSource *) source;
+
+  G_LOCK (looper_sources);
+  ALooper_release (looper_source->looper);
+  G_UNLOCK (looper_sources);
+
+  /* The polling thread drops its own reference, see prune_fd_registries() */
+  if (looper_source->registry)
+    fd_registry_unref (looper_source->registry);
+
+  if (looper_source->background_source)
+    g_source_unref (looper_source->background_source);
+}
+
+static GSourceFuncs looper_source_funcs =
+{
+  looper_source_prepare,
+  looper_source_check,
+  looper_source_dispatch,
+  looper_source_finalize
+};
+
+static GAndroidLooperSource *
+_find_looper_source (GMainContext *context)
+{
+  GSource *source;
+
+  source = g_main_context_find_source_by_funcs_user_data (context,
+                                                          &looper_source_funcs,
+                                                          NULL);
+
+  return (GAndroidLooperSource *) source;
+}
+
+/*
+ * Budget for the processing of LOOPER_ID_MAIN and LOOPER_ID_INPUT events in a
+ * single g_android_poll() invocation, see g_android_set_glue_budget()
+ */
+static guint glue_max_events = G_ANDROID_GLUE_DEFAULT_MAX_EVENTS;
+static guint glue_max_time = G_ANDROID_GLUE_DEFAULT_MAX_TIME;
+
+/* Accounts for what ended the wait of a poll */
+static void
+count_wakeup (GAndroidLoopStats *stats,
+              gint               res)
+{
+  switch (res)
+    {
+    case LOOPER_ID_MAIN:
+      stats->n_wakeups_main++;
+      break;
+    case LOOPER_ID_INPUT:
+      stats->n_wakeups_input++;
+      break;
+    case ALOOPER_POLL_TIMEOUT:
+      stats->n_wakeups_timeout++;
+      break;
+    case ALOOPER_POLL_WAKE:
+      stats->n_wakeups_wake++;
+      break;
+    case ALOOPER_POLL_ERROR:
+      break;
+    default:
+      /* LOOPER_ID_USER, LOOPER_ID_SOURCE or fd callbacks */
+      stats->n_wakeups_fd++;
+      break;
+    }
+}
+
+/*
+ * Removes the fd of @id for @app from the looper until the sources attached
+ * to other contexts have read from it, see GAndroidGlueSource
+ */
+static void
+mask_glue_fd (GAndroidPollState  *state,
+              struct android_app *app,
+              gint32              id,
+              gint                fd,
+              void               *data)
+{
+  GAndroidMaskedGlue masked;
+  guint i;
+
+  /* the looper had a response queued from before */
+  for (i = 0; i < state->masked_glue->len; i++)
+    if (g_array_index (state->masked_glue, GAndroidMaskedGlue, i).fd == fd)
+      return;
+
+  G_ANDROID_NOTE ("Masking %s", looper_id_to_string (id));
+  ALooper_removeFd (state->looper, fd);
+
+  masked.app = app;
+  masked.id = id;
+  masked.fd = fd;
+  masked.data = data;
+  masked.queue = app->inputQueue;
+  g_array_append_val (state->masked_glue, masked);
+}
+
+/* Adds back the fds of the glue the sources have read from since masked */
+static void
+unmask_glue_fds (GAndroidPollState *state)
+{
+  GAndroidMaskedGlue *masked;
+  guint i = 0;
+
+  while (i < state->masked_glue->len)
+    {
+      masked = &g_array_index (state->masked_glue, GAndroidMaskedGlue, i);
+      if (glue_source_is_masked (masked->app, masked->id))
+        {
+          i++;
+          continue;
+        }
+
+      /* A new input queue has been attached to the looper in the meantime */
+      G_ANDROID_NOTE ("Unmasking %s", looper_id_to_string (masked->id));
+      if (masked->id == LOOPER_ID_MAIN ||
+          masked->app->inputQueue == masked->queue)
+        ALooper_addFd (state->looper, masked->fd, masked->id,
+                       ALOOPER_EVENT_INPUT, NULL, masked->data);
+
+      g_array_remove_index_fast (state->masked_glue, i);
+    }
+}
+
+/* Responses dropped by a single drain_looper() */
+#define DRAIN_MAX_RESPONSES 64
+
+/*
+ * The looper hands out the responses of an epoll_wait() one at a time and we
+ * usually return to GLib before having exhausted them, so the responses still
+ * queued by the next invocation can be about fds GLib has read since. They
+ * are dropped first, once per invocation, rather than checked one by one.
+ * Until the looper polls again, which shows as an fd coming back, they can't
+ * be told apart from fresh ones, but the looper is level-triggered: the fds
+ * still ready are reported again. In callback mode, the callbacks run
+ * meanwhile don't signal their fds either, the registry has no array to
+ * signal them in yet. Returns what ended the drain.
+ */
+static gint
+drain_looper (GAndroidPollState *state,
+              gboolean           use_callbacks)
+{
+  gint seen[DRAIN_MAX_RESPONSES];
+  gint res, out_fd, out_events, i, n_seen = 0;
+  void *out_data;
+
+  for (;;)
+    {
+      if (use_callbacks)
+        res = ALooper_pollOnce (0, &out_fd, &out_events, &out_data);
+      else
+        res = ALooper_pollAll (0, &out_fd, &out_events, &out_data);
+
+      if (res < 0)
+        break;
+
+      for (i = 0; i < n_seen; i++)
+        if (seen[i] == out_fd)
+          break;
+
+      if (i < n_seen || n_seen == DRAIN_MAX_RESPONSES)
+        break;
+
+      G_ANDROID_NOTE ("Dropping queued %s for fd %d", looper_id_to_string (res),
+                      out_fd);
+      seen[n_seen++] = out_fd;
+    }
+
+  state->queued = res >= 0;
+
+  return res;
+}
+
+/*
+ * Once woken up, we keep on polling the looper without blocking to gather all
+ * the fds that are ready and report them all to GLib in one go instead of one
+ * per main loop iteration.
+ *
+ * fds stay registered with the looper after having been signalled. The looper
+ * is level-triggered, an fd that is still ready will be reported again, so
+ * seeing an fd we have already reported in this invocation means we've
+ * gathered all the ready fds.
+ *
+ * ALooper_wake() makes ALooper_pollAll() return ALOOPER_POLL_WAKE, this is
+ * what g_android_context_wakeup() uses to interrupt the poll. We return right
+ * away so GLib checks its sources again.
+ *
+ * The commands and input events of android_native_app_glue are processed
+ * inline, as they come, unless a GSource created with
+ * g_android_app_source_new() or g_android_input_source_new() takes care of
+ * them. Once the glue budget is spent we hand control back to GLib even if
+ * more of them are pending, so a flood of input events can't starve the GLib
+ * sources. The looper is level-triggered, the remaining ones will be
+ * processed by the next poll.
+ *
+ * In callback mode, ALooper_pollOnce() returns ALOOPER_POLL_CALLBACK once it
+ * has run the callbacks of the ready fds. A round of callbacks that doesn't
+ * signal any new fd means we've gathered all the ready fds.
+ *
+ * The responses left queued by the previous invocation are dropped first, see
+ * drain_looper().
+ */
+static gint
+poll_looper (GAndroidPollState  *state,
+             GAndroidFdRegistry *registry,
+             GMainContext       *context,
+             GAndroidLoopStats  *stats,
+             GPollFD            *fds,
+             guint               n_fds,
+             gint                timeout_,
+             gboolean            use_callbacks)
+{
+  GAndroidFd *entry;
+  gint res, out_fd, out_events, n_ready, n_new;
+  gint64 deadline, glue_start, poll_start, process_start, now;
+  guint n_processed;
+  void *out_data;
+
+  update_looper_fds (state, registry, context, stats, fds, n_fds,
+                     use_callbacks);
+  if (state->masked_glue->len > 0)
+    unmask_glue_fds (state);
+  registry->n_new_ready = 0;
+
+  /* the callbacks run by the drain are ignored like the responses it drops,
+   * see looper_fd_ready() */
+  registry->poll_fds = NULL;
+  if (state->queued)
+    {
+      res = drain_looper (state, use_callbacks);
+      if (res == ALOOPER_POLL_WAKE)
+        {
+          state->wake_time = g_get_monotonic_time ();
+          count_wakeup (stats, res);
+          return 0;
+        }
+    }
+  registry->poll_fds = fds;
+
+  n_ready = 0;
+  n_processed = 0;
+  glue_start = 0;
+
+  /* We may have to re-enter the poll after handling LOOPER_ID_MAIN and
+   * LOOPER_ID_INPUT events, the remaining timeout is then derived from this
+   * absolute deadline so re-entering doesn't accumulate rounding errors */
+  deadline = -1;
+  if (timeout_ > 0)
+    deadline = g_get_monotonic_time () + (gint64) timeout_ * 1000;
+
+  /* It's time to poll now */
+poll:
+  G_ANDROID_NOTE ("Waiting in pollAll() for %dms", timeout_);
+  poll_start = g_get_monotonic_time ();
+  if (use_callbacks)
+    res = ALooper_pollOnce (timeout_, &out_fd, &out_events, &out_data);
+  else
+    res = ALooper_pollAll (timeout_, &out_fd, &out_events, &out_data);
+  state->queued = res >= 0;
+
+  now = g_get_monotonic_time ();
+  stats->blocked_time += now - poll_start;
+  if (state->wake_time == 0)
+    {
+      state->wake_time = now;
+      count_wakeup (stats, res);
+    }
+
+  /* fds signalled by looper_fd_ready() */
+  n_new = registry->n_new_ready;
+  if (n_new > 0)
+    {
+      registry->n_new_ready = 0;
+      n_ready += n_new;
+      timeout_ = 0;
+    }
+
+  if (res == ALOOPER_POLL_CALLBACK)
+    {
+      if (n_new == 0)
+        return n_ready;
+
+      goto poll;
+    }
+
+  /* FIXME: let's assume that the underlying function behind ALooper_pollAll()
+   * sets errno */
+  if (res == ALOOPER_POLL_ERROR)
+    {
+      G_ANDROID_NOTE ("pollAll() returned an error (%d:%s)", errno,
+                      strerror (errno));
+
+      /* don't lose the fds we've already collected */
+      if (n_ready > 0)
+        return n_ready;
+
+      return -1;
+    }
+
+  if (res == ALOOPER_POLL_WAKE)
+    {
+      G_ANDROID_NOTE ("pollAll() woken up");
+      return n_ready;
+    }
+
+  /* A value of 0 indicates that the call timed out and no file descriptors
+   * were ready */
+  if (res == ALOOPER_POLL_TIMEOUT)
+    {
+      G_ANDROID_NOTE ("pollAll() timed out (%dms)", timeout_);
+      return n_ready;
+    }
+
+  G_ANDROID_NOTE ("Processing id %s", looper_id_to_string (res));
+
+  /* The glue provided in the NDK installs those two ids in the looper */
+  if (res == LOOPER_ID_MAIN || res == LOOPER_ID_INPUT)
+    {
+      struct android_poll_source *source = out_data;
+      gint64 remaining;
+      guint pending;
+
+      /* a GSource dispatches those, GLib will call it in priority order */
+      pending = source ? glue_source_set_pending (source->app, res, context)
+                       : 0;
+      if (pending)
+        {
+          G_ANDROID_NOTE ("Glue source for %s is pending",
+                          looper_id_to_string (res));
+          if (pending & GLUE_SOURCE_ELSEWHERE)
+            mask_glue_fd (state, source->app, res, out_fd, out_data);
+          return n_ready;
+        }
+
+      if (n_processed == 0)
+        glue_start = now;
+
+      process_start = now;
+      if (source && source->process)
+        source->process (source->app, source);
+
+      if (source && res == LOOPER_ID_MAIN)
+        update_activity_state (source->app);
+
+      n_processed++;
+      now = g_get_monotonic_time ();
+      stats->glue_time += now - process_start;
+
+      /* let GLib dispatch its sources before processing more events */
+      if ((glue_max_events > 0 && n_processed >= glue_max_events) ||
+          (glue_max_time > 0 && now - glue_start >= glue_max_time))
+        {
+          G_ANDROID_NOTE ("Glue budget spent after %u events", n_processed);
+          return n_ready;
+        }
+
+      /* we are already draining the ready fds with a timeout of 0 */
+      if (n_ready > 0 || timeout_ <= 0)
+        goto poll;
+
+      /* compute the new timeout, note this is done after processing the
+       * MAIN and INPUT source, so we effectively take into account the time
+       * we just spent in those process() functions. Round up, waking up
+       * before the deadline would only have GLib poll again with a timeout
+       * of 0 */
+      remaining = deadline - now;
+      if (remaining <= 0)
+        return 0;
+
+      timeout_ = (remaining + 999) / 1000;
+
+      goto poll;
+    }
+
+  /* The source reads its fd when dispatched */
+  if (res == LOOPER_ID_SOURCE)
+    {
+      sensor_source_set_pending (out_data);
+      return n_ready;
+    }
+
+  if (G_UNLIKELY (res != LOOPER_ID_USER))
+    {
+      G_ANDROID_NOTE ("Ignoring unknown id %d", res);
+      return n_ready;
+    }
+
+  /* We've been signaled a fd, let's update GPollFD.revents. The registry
+   * knows where the fd is in the array we've been given */
+  entry = g_hash_table_lookup (state->owners, GINT_TO_POINTER (out_fd));
+  if (G_UNLIKELY (entry != NULL && entry->registry != registry))
+    {
+      /* The fd belongs to another context polled by this thread, which is
+       * waiting for us to return. It adds the fd back when it polls again */
+      G_ANDROID_NOTE ("Removing fd %d of another context", out_fd);
+      remove_fd_from_looper (state->looper, out_fd);
+      g_hash_table_remove (state->owners, GINT_TO_POINTER (out_fd));
+      entry->ident = -1;
+      stats->n_remove_fd++;
+      goto poll;
+    }
+
+  if (G_UNLIKELY (entry == NULL || entry->serial != registry->serial ||
+                  entry->ident != LOOPER_ID_USER))
+    {
+      /* The looper still had responses queued from a previous invocation,
+       * for an fd that has been removed or registered with a callback since,
+       * see what else it has */
+      G_ANDROID_NOTE ("Ignoring stale event for fd %d", out_fd);
+      goto poll;
+    }
+
+  /* We've gone through all the ready fds */
+  if (entry->signalled == registry->serial)
+    {
+      G_ANDROID_NOTE ("fd %d already signalled", out_fd);
+      n_ready += signal_fd_slots (registry, entry, out_events);
+      return n_ready;
+    }
+
+  G_ANDROID_NOTE ("Signalling fd %d", out_fd);
+  n_ready += signal_fd_slots (registry, entry, out_events);
+
+  /* Collect the other fds that are already ready, without blocking */
+  timeout_ = 0;
+  goto poll;
+}
+
+/*
+ * Timer slack: the deadline of the poll is pushed back to the next tick of a
+ * grid of period slack, based on the monotonic clock and thus shared by all
+ * the contexts using the same slack. Timers expiring close to each other, in
+ * one context or across contexts, then wake the CPU up once. The original
+ * deadline is kept to account for the wakeups saved:
+ *   - being woken up by an fd after the original deadline, the timers due are
+ *     dispatched along with that fd,
+ *   - reaching a tick another context has already been woken up at.
+ */
+G_LOCK_DEFINE_STATIC (slack_tick);
+static gint64 last_slack_tick;
+
+/*
+ * Bucket of the latency histogram of GAndroidLoopStats, the latency being
+ * the time between the looper waking us up and the poll returning to GLib
+ */
+static guint
+latency_to_bucket (gint64 latency)
+{
+  guint bucket;
+
+  if (latency <= 0)
+    return 0;
+
+  bucket = g_bit_storage ((gulong) MIN (latency, G_MAXINT32));
+
+  return MIN (bucket, G_ANDROID_LOOP_STATS_N_BUCKETS - 1);
+}
+
+/*
+ * Returns the registry of the context of looper_source, a new one when it is
+ * first polled by this thread
+ */
+static GAndroidFdRegistry *
+get_fd_registry (GAndroidPollState    *state,
+                 GAndroidLooperSource *looper_source)
+{
+  GAndroidFdRegistry *registry = looper_source->registry;
+
+  if (G_LIKELY (registry != NULL &&
+                g_atomic_pointer_get (&registry->owner) == state))
+    return registry;
+
+  /* The thread that polled the context before drops its registry the next
+   * time it switches context or when it exits */
+  if (registry != NULL)
+    fd_registry_unref (registry);
+
+  registry = fd_registry_new (state);
+  g_atomic_int_inc (&registry->ref_count);
+  state->registries = g_slist_prepend (state->registries, registry);
+  looper_source->registry = registry;
+
+  return registry;
+}
+
+static gint
+_g_android_poll (GPollFD  *fds,
+                 guint     n_fds,
+                 gint      timeout_,
+                 gboolean  use_callbacks)
+{
+  GAndroidPollState *state;
+  GAndroidLooperSource *looper_source;
+  GAndroidFdRegistry *registry;
+  GMainContext *context;
+  GAndroidTimerSlackStats *slack_stats = NULL;
+  GAndroidLoopStats *stats;
+  gint64 now, timer_deadline = -1, tick = -1, slack;
+  gboolean background_ready;
+  guint slack_ms;
+  gint n_ready;
+
+  state = _get_poll_state ();
+  if (G_UNLIKELY (state == NULL))
+    {
+      g_critical ("Could not retrieve the ALooper object");
+      return -1;
+    }
+
+  looper_source = (GAndroidLooperSource *) state->context_source;
+  state->context_source = NULL;
+  background_ready = state->background_ready;
+  state->background_ready = FALSE;
+
+  /* A ready background source makes the timeout 0, wait for the sources it
+   * doesn't hold back instead, see the background policy */
+  if (background_ready)
+    timeout_ = state->background_timeout;
+
+  stats = looper_source ? &looper_source->loop_stats : &state->loop_stats;
+  stats->n_polls++;
+  state->wake_time = 0;
+
+  context = NULL;
+  registry = state->default_registry;
+  if (looper_source)
+    {
+      context = g_source_get_context ((GSource *) looper_source);
+      registry = get_fd_registry (state, looper_source);
+    }
+  if (registry != state->registry)
+    {
+      prune_fd_registries (state);
+      state->registry = registry;
+    }
+
+  slack_ms = 0;
+  if (looper_source)
+    {
+      slack_ms = looper_source->slack;
+      if (g_atomic_int_get (&activity_paused))
+        slack_ms = MAX (slack_ms, looper_source->background_slack);
+    }
+
+  if (slack_ms > 0 && timeout_ > 0)
+    {
+      slack_stats = &looper_source->slack_stats;
+      slack_stats->n_timer_polls++;
+
+      slack = (gint64) slack_ms * 1000;
+      now = g_get_monotonic_time ();
+      timer_deadline = now + (gint64) timeout_ * 1000;
+      tick = (timer_deadline + slack - 1) / slack * slack;
+
+      if (tick != timer_deadline)
+        {
+          slack_stats->n_aligned++;
+          timeout_ = (tick - now + 999) / 1000;
+        }
+    }
+
+  if (G_UNLIKELY (registry->wakeup_fd == -1 && context != NULL &&
+                  registry->n_wakeup_probes < WAKEUP_MAX_PROBES))
+    find_wakeup_fd (registry, context, fds, n_fds);
+
+  n_ready = poll_looper (state, registry, context, stats, fds, n_fds, timeout_,
+                         use_callbacks);
+
+  now = g_get_monotonic_time ();
+  if (state->dispatch_source != (GSource *) looper_source)
+    {
+      if (state->dispatch_source)
+        g_source_unref (state->dispatch_source);
+      state->dispatch_source = looper_source ?
+        g_source_ref ((GSource *) looper_source) : NULL;
+    }
+  if (looper_source && looper_source->profiling)
+    looper_source->dispatch_start = now;
+  if (state->wake_time > 0)
+    stats->latency[latency_to_bucket (now - state->wake_time)]++;
+
+  if (slack_stats == NULL)
+    return n_ready;
+
+  if (now >= tick)
+    {
+      slack_stats->n_timer_wakeups++;
+
+      G_LOCK (slack_tick);
+      if (tick == last_slack_tick)
+        slack_stats->n_wakeups_saved++;
+      last_slack_tick = tick;
+      G_UNLOCK (slack_tick);
+    }
+  else if (now >= timer_deadline)
+    {
+      slack_stats->n_wakeups_saved++;
+    }
+
+  return n_ready;
+}
+
+static gint
+g_android_poll (GPollFD *fds,
+                guint    n_fds,
+                gint     timeout_)
+{
+  return _g_android_poll (fds, n_fds, timeout_, FALSE);
+}
+
+static gint
+g_android_poll_callbacks (GPollFD *fds,
+                          guint    n_fds,
+                          gint     timeout_)
+{
+  return _g_android_poll (fds, n_fds, timeout_, TRUE);
+}
+
+/**
+ * g_android_app_source_new:
+ * @app: the #android_app of the native activity
+ *
+ * Creates a #GSource dispatching the commands the activity sends to @app,
+ * such as %APP_CMD_INIT_WINDOW, instead of having them processed as soon as
+ * the looper reports them. The callback, a #GAndroidAppFunc set with
+ * g_source_set_callback(), is called in place of @app->onAppCmd, between the
+ * pre and post processing of the glue.
+ *
+ * Being a #GSource, commands are dispatched according to the priority of the
+ * source relative to the other sources of its context.
+ *
+ * Returns: (transfer full): a new #GSource
+ */
+GSource *
+g_android_app_source_new (struct android_app *app)
+{
+  GSource *source;
+
+  g_return_val_if_fail (app != NULL, NULL);
+
+  source = glue_source_new (&app_source_funcs, sizeof (GAndroidGlueSource), app,
+                            LOOPER_ID_MAIN);
+  g_source_set_name (source, "GAndroidAppSource");
+
+  return source;
+}
+
+/**
+ * g_android_input_source_new:
+ * @app: the #android_app of the native activity
+ *
+ * Creates a #GSource dispatching the input events of @app, one per dispatch.
+ * The callback, a #GAndroidInputFunc set with g_source_set_callback(), is
+ * called in place of @app->onInputEvent and returns whether the event has
+ * been handled.
+ *
+ * Returns: (transfer full): a new #GSource
+ */
+GSource *
+g_android_input_source_new (struct android_app *app)
+{
+  GSource *source;
+
+  g_return_val_if_fail (app != NULL, NULL);
+
+  source = glue_source_new (&input_source_funcs, sizeof (GAndroidGlueSource),
+                            app, LOOPER_ID_INPUT);
+  g_source_set_name (source, "GAndroidInputSource");
+
+  return source;
+}
+
+/**
+ * g_android_input_batch_source_new:
+ * @app: the #android_app of the native activity
+ * @flags: #GAndroidInputBatchFlags
+ *
+ * Creates a #GSource dispatching the input events of @app in batches: each
+ * dispatch drains up to %G_ANDROID_INPUT_BATCH_MAX events from the input
+ * queue and hands them to the callback, a #GAndroidInputBatchFunc set with
+ * g_source_set_callback(), in one call.
+ *
+ * With %G_ANDROID_INPUT_BATCH_COALESCE_MOTION, consecutive
+ * %AMOTION_EVENT_ACTION_MOVE events of the same pointers are coalesced, only
+ * the latest one is delivered and the others are finished as handled.
+ *
+ * Returns: (transfer full): a new #GSource
+ */
+GSource *
+g_android_input_batch_source_new (struct android_app      *app,
+                                  GAndroidInputBatchFlags  flags)
+{
+  GAndroidInputBatchSource *batch_source;
+  GSource *source;
+
+  g_return_val_if_fail (app != NULL, NULL);
+
+  source = glue_source_new (&input_batch_source_funcs,
+                            sizeof (GAndroidInputBatchSource),
+                            app, LOOPER_ID_INPUT);
+  batch_source = (GAndroidInputBatchSource *) source;
+  batch_source->flags = flags;
+  g_source_set_name (source, "GAndroidInputBatchSource");
+
+  return source;
+}
+
+/**
+ * g_android_sensor_source_new:
+ * @manager: the #ASensorManager
+ * @max_events: size of the buffer of events, at least 1
+ *
+ * Creates a #GSource receiving sensor events. The source owns an
+ * #ASensorEventQueue created on the looper of the calling thread, use
+ * g_android_sensor_source_get_queue() to enable sensors on it. The source
+ * has to be attached to a context run by the calling thread.
+ *
+ * Events are read in bulk, up to @max_events at a time, and handed to the
+ * callback, a #GAndroidSensorFunc set with g_source_set_callback(). See
+ * g_android_sensor_source_set_latency() to have them batched over time.
+ *
+ * Returns: (transfer full): a new #GSource, or %NULL if no event queue could
+ *   be created
+ */
+GSource *
+g_android_sensor_source_new (ASensorManager *manager,
+                             guint           max_events)
+{
+  GAndroidSensorSource *sensor_source;
+  GAndroidPollState *state;
+  GSource *source;
+
+  g_return_val_if_fail (manager != NULL, NULL);
+  g_return_val_if_fail (max_events > 0, NULL);
+
+  state = _get_poll_state ();
+  if (G_UNLIKELY (state == NULL))
+    return NULL;
+
+  source = g_source_new (&sensor_source_funcs, sizeof (GAndroidSensorSource));
+  sensor_source = (GAndroidSensorSource *) source;
+  sensor_source->manager = manager;
+  sensor_source->events = g_new (ASensorEvent, max_events);
+  sensor_source->max_events = max_events;
+  sensor_source->queue = ASensorManager_createEventQueue (manager,
+                                                          state->looper,
+                                                          LOOPER_ID_SOURCE,
+                                                          NULL, source);
+  if (G_UNLIKELY (sensor_source->queue == NULL))
+    {
+      g_free (sensor_source->events);
+      sensor_source->events = NULL;
+      g_source_unref (source);
+      return NULL;
+    }
+
+  G_LOCK (sensor_sources);
+  if (sensor_sources == NULL)
+    sensor_sources = g_hash_table_new (NULL, NULL);
+  g_hash_table_insert (sensor_sources, source, source);
+  G_UNLOCK (sensor_sources);
+
+  g_source_set_name (source, "GAndroidSensorSource");
+
+  return source;
+}
+
+/**
+ * g_android_sensor_source_get_queue:
+ * @source: a #GSource created with g_android_sensor_source_new()
+ *
+ * Returns: (transfer none): the #ASensorEventQueue of @source
+ */
+ASensorEventQueue *
+g_android_sensor_source_get_queue (GSource *source)
+{
+  GAndroidSensorSource *sensor_source = (GAndroidSensorSource *) source;
+
+  g_return_val_if_fail (source != NULL, NULL);
+
+  return sensor_source->queue;
+}
+
+/**
+ * g_android_sensor_source_set_latency:
+ * @source: a #GSource created with g_android_sensor_source_new()
+ * @latency: maximum time in microseconds events are held for
+ *
+ * Batches events over time: events are dispatched once the buffer of @source
+ * is full or @latency after the first event has been read, whichever comes
+ * first. The default latency is 0, events are dispatched as they come.
+ */
+void
+g_android_sensor_source_set_latency (GSource *source,
+                                     guint    latency)
+{
+  GAndroidSensorSource *sensor_source = (GAndroidSensorSource *) source;
+
+  g_return_if_fail (source != NULL);
+
+  sensor_source->latency = latency;
+}
+
+/**
+ * g_android_frame_source_new:
+ * @interval: the frame interval in microseconds, eg. 16667 for a 60Hz display
+ *
+ * Creates a #GSource ticking once per frame. The callback, a
+ * #GAndroidFrameFunc set with g_source_set_callback(), is given the time of
+ * the frame and the time it is expected to be presented, one interval later.
+ *
+ * Frames are laid on a grid of period @interval of the monotonic clock, so
+ * ticks don't drift like a g_timeout_add() rearmed every frame. When a frame
+ * takes longer than @interval, the frames missed meanwhile are skipped rather
+ * than dispatched in a row, and the callback is told how many.
+ *
+ * The source doesn't tick while the activity is paused or stopped.
+ *
+ * Returns: the newly-created frame source
+ */
+GSource *
+g_android_frame_source_new (guint interval)
+{
+  GAndroidFrameSource *frame_source;
+  GSource *source;
+
+  g_return_val_if_fail (interval > 0, NULL);
+
+  source = g_source_new (&frame_source_funcs, sizeof (GAndroidFrameSource));
+  frame_source = (GAndroidFrameSource *) source;
+  frame_source->interval = interval;
+  frame_source->poll_fd.fd = -1;
+  g_source_set_name (source, "GAndroidFrameSource");
+
+#ifdef HAVE_SYS_TIMERFD_H
+  frame_source->poll_fd.fd = timerfd_create (CLOCK_MONOTONIC,
+                                             TFD_NONBLOCK | TFD_CLOEXEC);
+  if (frame_source->poll_fd.fd != -1)
+    {
+      frame_source->poll_fd.events = G_IO_IN;
+      g_source_add_poll (source, &frame_source->poll_fd);
+    }
+#endif
+
+  return source;
+}
+
+/**
+ * g_android_set_glue_budget:
+ * @max_events: maximum number of commands and input events, or 0
+ * @max_time: maximum time in microseconds, or 0
+ *
+ * Bounds the processing of android_native_app_glue commands and input events
+ * done by a single poll of the main loop. Once @max_events have been
+ * processed or @max_time has elapsed since the first one, the poll returns
+ * and GLib dispatches its sources before the remaining events are processed.
+ * A value of 0 removes the corresponding limit.
+ *
+ * The defaults are %G_ANDROID_GLUE_DEFAULT_MAX_EVENTS and
+ * %G_ANDROID_GLUE_DEFAULT_MAX_TIME. This applies to all the attached
+ * contexts and should be called before running them.
+ */
+void
+g_android_set_glue_budget (guint max_events,
+                           guint max_time)
+{
+  glue_max_events = max_events;
+  glue_max_time = max_time;
+}
+
+/**
+ * g_android_set_timer_slack:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ * @slack: the slack in milliseconds, or 0 to disable it
+ *
+ * Lets @context wake up to @slack milliseconds after the expiration of its
+ * earliest timeout. The deadline of each poll is aligned to a grid of period
+ * @slack shared by all the contexts, so timeouts expiring close to each other
+ * are dispatched together and contexts using the same slack wake up at the
+ * same time, keeping the CPU idle for longer. Timeouts are never dispatched
+ * early.
+ *
+ * Returns: %TRUE on success, %FALSE if @context isn't attached
+ */
+gboolean
+g_android_set_timer_slack (GMainContext *context,
+                           guint         slack)
+{
+  GAndroidLooperSource *looper_source;
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  looper_source = _find_looper_source (context);
+  g_return_val_if_fail (looper_source != NULL, FALSE);
+
+  looper_source->slack = slack;
+
+  return TRUE;
+}
+
+/**
+ * g_android_get_timer_slack_stats:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ * @stats: (out): return location for the counters
+ *
+ * Retrieves the counters of the timer slack policy of @context, see
+ * #GAndroidTimerSlackStats. They are updated by the thread polling @context
+ * and only count the polls done with a non-zero slack.
+ */
+void
+g_android_get_timer_slack_stats (GMainContext            *context,
+                                 GAndroidTimerSlackStats *stats)
+{
+  GAndroidLooperSource *looper_source;
+
+  g_return_if_fail (stats != NULL);
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  memset (stats, 0, sizeof (GAndroidTimerSlackStats));
+
+  looper_source = _find_looper_source (context);
+  g_return_if_fail (looper_source != NULL);
+
+  *stats = looper_source->slack_stats;
+}
+
+/**
+ * g_android_get_loop_stats:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ * @stats: (out): return location for the statistics
+ *
+ * Retrieves the statistics of the polls of @context, see #GAndroidLoopStats.
+ * They are maintained by the thread polling @context without any locking and
+ * are always on. Read from another thread while @context runs, they are only
+ * a close approximation.
+ */
+void
+g_android_get_loop_stats (GMainContext      *context,
+                          GAndroidLoopStats *stats)
+{
+  GAndroidLooperSource *looper_source;
+
+  g_return_if_fail (stats != NULL);
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  memset (stats, 0, sizeof (GAndroidLoopStats));
+
+  looper_source = _find_looper_source (context);
+  g_return_if_fail (looper_source != NULL);
+
+  *stats = looper_source->loop_stats;
+}
+
+/**
+ * g_android_reset_loop_stats:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ *
+ * Resets the statistics of the polls of @context. To be called from the
+ * thread running @context, or while it isn't running.
+ */
+void
+g_android_reset_loop_stats (GMainContext *context)
+{
+  GAndroidLooperSource *looper_source;
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  looper_source = _find_looper_source (context);
+  g_return_if_fail (looper_source != NULL);
+
+  memset (&looper_source->loop_stats, 0, sizeof (GAndroidLoopStats));
+}
+
+/**
+ * g_android_set_background_slack:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ * @slack: the slack in milliseconds, or 0 to disable it
+ *
+ * Sets the timer slack @context uses while the activity is paused or stopped,
+ * when it is wider than the one set with g_android_set_timer_slack().
+ *
+ * Returns: %TRUE on success, %FALSE if @context isn't attached
+ */
+gboolean
+g_android_set_background_slack (GMainContext *context,
+                                guint         slack)
+{
+  GAndroidLooperSource *looper_source;
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  looper_source = _find_looper_source (context);
+  g_return_val_if_fail (looper_source != NULL, FALSE);
+
+  looper_source->background_slack = slack;
+
+  return TRUE;
+}
+
+/**
+ * g_android_set_background_priority:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ * @priority: the lowest priority still dispatched in the background, or
+ *   %G_MAXINT to dispatch all the sources
+ *
+ * Holds back the sources of @context with a lower priority than @priority
+ * while the activity is paused or stopped, until it is resumed. This is meant
+ * for low priority work, like idles, that is useless when the activity isn't
+ * visible. Their fds aren't polled meanwhile, and a timeout that expired in
+ * the background is dispatched once on resume.
+ *
+ * The sources of @priority or higher are dispatched as usual, their timeouts
+ * aligned on the background slack of @context, see
+ * g_android_set_background_slack().
+ *
+ * Returns: %TRUE on success, %FALSE if @context isn't attached
+ */
+gboolean
+g_android_set_background_priority (GMainContext *context,
+                                   gint          priority)
+{
+  GAndroidLooperSource *looper_source;
+  GSource *source;
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  looper_source = _find_looper_source (context);
+  g_return_val_if_fail (looper_source != NULL, FALSE);
+
+  source = looper_source->background_source;
+  if (priority == G_MAXINT)
+    {
+      if (source)
+        {
+          looper_source->background_source = NULL;
+          g_source_destroy (source);
+          g_source_unref (source);
+        }
+
+      return TRUE;
+    }
+
+  if (source)
+    {
+      g_source_set_priority (source, priority);
+      return TRUE;
+    }
+
+  source = g_source_new (&background_source_funcs, sizeof (GSource));
+  g_source_set_priority (source, priority);
+
+  G_LOCK (background_sources);
+  background_sources = g_slist_prepend (background_sources, source);
+  G_UNLOCK (background_sources);
+
+  g_source_attach (source, context);
+  looper_source->background_source = source;
+
+  return TRUE;
+}
+
+/**
+ * g_android_activity_is_paused:
+ *
+ * Tells whether the activity is in the background, ie. the last
+ * %APP_CMD_PAUSE or %APP_CMD_STOP command hasn't been followed by
+ * %APP_CMD_START or %APP_CMD_RESUME yet. This tracks the commands processed
+ * by the attached contexts.
+ *
+ * Returns: %TRUE if the activity is paused or stopped
+ */
+gboolean
+g_android_activity_is_paused (void)
+{
+  return g_atomic_int_get (&activity_paused);
+}
+
+/**
+ * g_android_set_dispatch_profiling:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ * @enabled: whether to profile the dispatches of @context
+ *
+ * Times the dispatches of @context, see g_android_get_dispatch_profiles().
+ * The time the sources set profiled with g_android_source_set_profiled()
+ * don't take is accounted to the "Unprofiled sources" profile.
+ *
+ * Returns: %TRUE on success, %FALSE if @context isn't attached
+ */
+gboolean
+g_android_set_dispatch_profiling (GMainContext *context,
+                                  gboolean      enabled)
+{
+  GAndroidLooperSource *looper_source;
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  looper_source = _find_looper_source (context);
+  g_return_val_if_fail (looper_source != NULL, FALSE);
+
+  looper_source->profiling = enabled;
+  if (!enabled)
+    looper_source->dispatch_start = 0;
+
+  return TRUE;
+}
+
+/**
+ * g_android_source_set_profiled:
+ * @source: a #GSource
+ * @profiled: whether to profile the dispatches of @source on its own
+ *
+ * Times the dispatches of @source apart from the others of its context, once
+ * g_android_set_dispatch_profiling() has been enabled for it. They are
+ * accounted to the name of @source, so set it with g_source_set_name() before
+ * its first dispatch to tell apart sources of the same type.
+ *
+ * This wraps the callback of @source and has to be called after setting it,
+ * before attaching @source or from the thread running its context.
+ */
+void
+g_android_source_set_profiled (GSource  *source,
+                               gboolean  profiled)
+{
+  GAndroidProfiledCallback *callback;
+
+  g_return_if_fail (source != NULL);
+
+  if (profiled == (source->callback_funcs == &profiled_callback_funcs))
+    return;
+
+  /* g_source_set_callback_indirect() drops the reference of @source on the
+   * callback it replaces */
+  if (profiled)
+    {
+      callback = g_slice_new0 (GAndroidProfiledCallback);
+      callback->ref_count = 1;
+      callback->funcs = source->callback_funcs;
+      callback->data = source->callback_data;
+      if (callback->funcs)
+        callback->funcs->ref (callback->data);
+
+      g_source_set_callback_indirect (source, callback,
+                                      &profiled_callback_funcs);
+    }
+  else
+    {
+      callback = source->callback_data;
+      if (callback->funcs)
+        callback->funcs->ref (callback->data);
+
+      g_source_set_callback_indirect (source, callback->data, callback->funcs);
+    }
+}
+
+static gint
+compare_profiles (gconstpointer a,
+                  gconstpointer b)
+{
+  const GAndroidDispatchProfile *profile_a = a, *profile_b = b;
+
+  if (profile_a->total_time == profile_b->total_time)
+    return 0;
+
+  return profile_a->total_time < profile_b->total_time ? 1 : -1;
+}
+
+/**
+ * g_android_get_dispatch_profiles:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ * @profiles: (out caller-allocates) (array length=n_profiles): return
+ *   location for the profiles
+ * @n_profiles: the number of elements of @profiles, at most
+ *   %G_ANDROID_N_DISPATCH_PROFILES are kept
+ *
+ * Retrieves the dispatch profiles of @context, see
+ * g_android_set_dispatch_profiling(), the most time consuming first. As for
+ * g_android_get_loop_stats(), they are only a close approximation when read
+ * from another thread while @context runs.
+ *
+ * Returns: the number of profiles written to @profiles
+ */
+guint
+g_android_get_dispatch_profiles (GMainContext            *context,
+                                 GAndroidDispatchProfile *profiles,
+                                 guint                    n_profiles)
+{
+  GAndroidDispatchProfile all[G_ANDROID_N_DISPATCH_PROFILES];
+  GAndroidLooperSource *looper_source;
+  guint n;
+
+  g_return_val_if_fail (profiles != NULL || n_profiles == 0, 0);
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  looper_source = _find_looper_source (context);
+  g_return_val_if_fail (looper_source != NULL, 0);
+
+  n = MIN (looper_source->n_profiles, G_ANDROID_N_DISPATCH_PROFILES);
+  memcpy (all, looper_source->profiles, n * sizeof (GAndroidDispatchProfile));
+  qsort (all, n, sizeof (GAndroidDispatchProfile), compare_profiles);
+
+  n = MIN (n_profiles, n);
+  memcpy (profiles, all, n * sizeof (GAndroidDispatchProfile));
+
+  return n;
+}
+
+/**
+ * g_android_get_slowest_dispatches:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ * @dispatches: (out caller-allocates) (array length=n_dispatches): return
+ *   location for the dispatches
+ * @n_dispatches: the number of elements of @dispatches, at most
+ *   %G_ANDROID_N_SLOWEST_DISPATCHES are kept
+ *
+ * Retrieves the slowest dispatches of @context, see
+ * g_android_get_dispatch_profiles(), the slowest first.
+ *
+ * Returns: the number of dispatches written to @dispatches
+ */
+guint
+g_android_get_slowest_dispatches (GMainContext         *context,
+                                  GAndroidSlowDispatch *dispatches,
+                                  guint                 n_dispatches)
+{
+  GAndroidLooperSource *looper_source;
+  guint n;
+
+  g_return_val_if_fail (dispatches != NULL || n_dispatches == 0, 0);
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  looper_source = _find_looper_source (context);
+  g_return_val_if_fail (looper_source != NULL, 0);
+
+  n = MIN (n_dispatches, looper_source->n_slowest);
+  memcpy (dispatches, looper_source->slowest,
+          n * sizeof (GAndroidSlowDispatch));
+
+  return n;
+}
+
+/**
+ * g_android_reset_dispatch_profiles:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ *
+ * Resets the dispatch profiles and the list of the slowest dispatches of
+ * @context. To be called from the thread running @context, or while it isn't
+ * running.
+ */
+void
+g_android_reset_dispatch_profiles (GMainContext *context)
+{
+  GAndroidLooperSource *looper_source;
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  looper_source = _find_looper_source (context);
+  g_return_if_fail (looper_source != NULL);
+
+  looper_source->n_profiles = 0;
+  looper_source->n_slowest = 0;
+}
+
+/**
+ * g_android_dump_dispatch_profiles:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ * @n_profiles: the maximum number of profiles to log
+ *
+ * Logs the @n_profiles most time consuming dispatch profiles and the slowest
+ * dispatches of @context, see g_android_get_dispatch_profiles() and
+ * g_android_get_slowest_dispatches().
+ */
+void
+g_android_dump_dispatch_profiles (GMainContext *context,
+                                  guint         n_profiles)
+{
+  GAndroidSlowDispatch dispatches[G_ANDROID_N_SLOWEST_DISPATCHES];
+  GAndroidDispatchProfile profiles[G_ANDROID_N_DISPATCH_PROFILES];
+  guint i, n;
+
+  n = g_android_get_dispatch_profiles (context, profiles,
+                                       MIN (n_profiles,
+                                            G_N_ELEMENTS (profiles)));
+
+  __android_log_print (ANDROID_LOG_INFO, G_LOG_DOMAIN,
+                       "Dispatch profiles (calls, total us, max us):");
+  for (i = 0; i < n; i++)
+    __android_log_print (ANDROID_LOG_INFO, G_LOG_DOMAIN,
+                         "  %-32s %8" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+                         " %8" G_GUINT64_FORMAT,
+                         profiles[i].name, profiles[i].n_dispatches,
+                         profiles[i].total_time, profiles[i].max_time);
+
+  n = g_android_get_slowest_dispatches (context, dispatches,
+                                        G_N_ELEMENTS (dispatches));
+
+  __android_log_print (ANDROID_LOG_INFO, G_LOG_DOMAIN,
+                       "Slowest dispatches (us, started at):");
+  for (i = 0; i < n; i++)
+    __android_log_print (ANDROID_LOG_INFO, G_LOG_DOMAIN,
+                         "  %-32s %8" G_GUINT64_FORMAT " %" G_GINT64_FORMAT,
+                         dispatches[i].name, dispatches[i].duration,
+                         dispatches[i].time);
+}
+
+/**
+ * g_android_attach_context:
+ * @context: a #GMainContext
+ *
+ * Makes @context poll its fds through the ALooper of the thread iterating it,
+ * so a worker thread running its own #GMainContext can watch the same fds as
+ * sensors or other loopers. A looper is prepared for the calling thread, and
+ * for any other thread that later iterates @context, if it doesn't have one.
+ *
+ * Call this from the thread that is going to run @context.
+ *
+ * Returns: %TRUE if a looper could be prepared for the calling thread
+ */
+gboolean
+g_android_attach_context (GMainContext *context)
+{
+  return g_android_attach_context_with_backend (context,
+                                                G_ANDROID_POLL_BACKEND_IDENT);
+}
+
+/**
+ * g_android_attach_context_with_backend:
+ * @context: a #GMainContext
+ * @backend: how the fds are registered with the looper
+ *
+ * Like g_android_attach_context(), choosing how the fds of @context are
+ * registered with the looper. %G_ANDROID_POLL_BACKEND_CALLBACK gathers all
+ * the fds ready at once in a single looper call and suits contexts with many
+ * fds.
+ *
+ * Returns: %TRUE if a looper could be prepared for the calling thread
+ */
+gboolean
+g_android_attach_context_with_backend (GMainContext        *context,
+                                       GAndroidPollBackend  backend)
+{
+  GAndroidPollState *state;
+  GAndroidLooperSource *looper_source;
+  GSource *source;
+
+  g_return_val_if_fail (context != NULL, FALSE);
+
+  state = _get_poll_state ();
+  if (G_UNLIKELY (state == NULL))
+    {
+      g_warning ("Could not prepare an ALooper for this thread");
+      return FALSE;
+    }
+
+  looper_source = _find_looper_source (context);
+  if (looper_source == NULL)
+    {
+      source = g_source_new (&looper_source_funcs,
+                             sizeof (GAndroidLooperSource));
+      looper_source = (GAndroidLooperSource *) source;
+      looper_source->looper = state->looper;
+      ALooper_acquire (state->looper);
+      /* g_main_context_find_source_by_funcs_user_data() skips the sources
+       * without a callback */
+      g_source_set_callback (source, NULL, NULL, NULL);
+      g_source_set_priority (source, G_MININT);
+      g_source_attach (source, context);
+      g_source_unref (source);
+    }
+  else if (looper_source->looper != state->looper)
+    {
+      G_LOCK (looper_sources);
+      ALooper_release (looper_source->looper);
+      looper_source->looper = state->looper;
+      ALooper_acquire (state->looper);
+      G_UNLOCK (looper_sources);
+    }
+
+  if (backend == G_ANDROID_POLL_BACKEND_CALLBACK)
+    g_main_context_set_poll_func (context, g_android_poll_callbacks);
+  else
+    g_main_context_set_poll_func (context, g_android_poll);
+
+  return TRUE;
+}
+
+/**
+ * g_android_context_wakeup:
+ * @context: (allow-none): a #GMainContext attached with
+ *   g_android_attach_context(), or %NULL for the default context
+ *
+ * Wakes up @context if it is blocked polling its looper, with ALooper_wake().
+ * Unlike g_main_context_wakeup(), this doesn't go through GLib's own wakeup
+ * fd: the looper acknowledges the wakeup itself and g_android_poll() returns
+ * straight away, saving a read of the GLib wakeup fd on the polling thread.
+ *
+ * This can be called from any thread.
+ */
+void
+g_android_context_wakeup (GMainContext *context)
+{
+  GAndroidLooperSource *looper_source;
+  ALooper *looper = NULL;
+
+  if (context == NULL)
+    context = g_main_context_default ();
+
+  /* The looper source isn't ours to keep from another thread: it can be
+   * finalized as soon as it is found, hold on to its looper instead. Its
+   * finalization waits for the lock, so it stays valid until then */
+  G_LOCK (looper_sources);
+  looper_source = _find_looper_source (context);
+  if (G_LIKELY (looper_source != NULL))
+    {
+      looper = looper_source->looper;
+      ALooper_acquire (looper);
+    }
+  G_UNLOCK (looper_sources);
+
+  if (G_UNLIKELY (looper_source == NULL))
+    {
+      g_main_context_wakeup (context);
+      return;
+    }
+
+  ALooper_wake (looper);
+  ALooper_release (looper);
+}
+
+/**
+ * g_android_init:
+ *
+ * Sends the messages of g_log() to the Android log, as well as the ones of
+ * g_log_structured() with GLib 2.50 or later, and attaches the default main
+ * context to the looper of the calling thread, see
+ * g_android_attach_context().
+ *
+ * GLib aborts if its writer function is set twice, so this has to be called
+ * before anything else installs one with g_log_set_writer_func(). A writer
+ * installed by the application instead can hand the messages over to
+ * g_android_log_writer().
+ *
+ * Returns: %TRUE if the default main context is attached
+ */
+gboolean
+g_android_init (void)
+{
+#if GLIB_CHECK_VERSION (2, 50, 0)
+  static gsize writer_set = 0;
+#endif
+
+  /* logs */
+  _g_android_log_init ();
+  g_log_set_default_handler (_g_android_log_handler, NULL);
+#if GLIB_CHECK_VERSION (2, 50, 0)
+  /* GLib aborts if the writer function is set twice */
+  if (g_once_init_enter (&writer_set))
+    {
+      g_log_set_writer_func (g_android_log_writer, NULL, NULL);
+      g_once_init_leave (&writer_set, TRUE);
+    }
+#endif
+
+  /* main loop */
+  return g_android_attach_context (g_main_context_default ());
 }
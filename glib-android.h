@@ -41,6 +41,364 @@
 
 #include <glib.h>
 
-gboolean        g_android_init          (void);
+#include <android/input.h>
+#include <android/sensor.h>
+
+struct android_app;
+
+/**
+ * GAndroidAppFunc:
+ * @app: the #android_app receiving the command
+ * @cmd: an APP_CMD_* command
+ * @user_data: data passed to g_source_set_callback()
+ *
+ * Callback of the sources created with g_android_app_source_new().
+ */
+typedef void     (* GAndroidAppFunc)    (struct android_app *app,
+                                         gint8               cmd,
+                                         gpointer            user_data);
+
+/**
+ * GAndroidInputFunc:
+ * @app: the #android_app receiving the event
+ * @event: the input event
+ * @user_data: data passed to g_source_set_callback()
+ *
+ * Callback of the sources created with g_android_input_source_new().
+ *
+ * Returns: %TRUE if the event has been handled
+ */
+typedef gboolean (* GAndroidInputFunc)  (struct android_app *app,
+                                         AInputEvent        *event,
+                                         gpointer            user_data);
+
+/* Maximum number of input events dispatched at once by a batch source */
+#define G_ANDROID_INPUT_BATCH_MAX       64
+
+/**
+ * GAndroidInputBatchFlags:
+ * @G_ANDROID_INPUT_BATCH_NONE: deliver all the events
+ * @G_ANDROID_INPUT_BATCH_COALESCE_MOTION: only deliver the latest of
+ *   consecutive move events of the same pointers
+ *
+ * Flags of g_android_input_batch_source_new().
+ */
+typedef enum
+{
+  G_ANDROID_INPUT_BATCH_NONE            = 0,
+  G_ANDROID_INPUT_BATCH_COALESCE_MOTION = 1 << 0
+} GAndroidInputBatchFlags;
+
+/**
+ * GAndroidInputBatchFunc:
+ * @app: the #android_app receiving the events
+ * @events: the input events, oldest first
+ * @handled: set handled[i] to %TRUE if events[i] has been handled, all the
+ *   elements are %FALSE on entry
+ * @n_events: the number of events in @events and @handled
+ * @user_data: data passed to g_source_set_callback()
+ *
+ * Callback of the sources created with g_android_input_batch_source_new().
+ */
+typedef void     (* GAndroidInputBatchFunc) (struct android_app  *app,
+                                             AInputEvent        **events,
+                                             gboolean            *handled,
+                                             guint                n_events,
+                                             gpointer             user_data);
+
+/**
+ * GAndroidSensorFunc:
+ * @events: the sensor events, oldest first
+ * @n_events: the number of events in @events
+ * @user_data: data passed to g_source_set_callback()
+ *
+ * Callback of the sources created with g_android_sensor_source_new().
+ *
+ * Returns: %FALSE if the source should be removed
+ */
+typedef gboolean (* GAndroidSensorFunc) (const ASensorEvent *events,
+                                         guint               n_events,
+                                         gpointer            user_data);
+
+/**
+ * GAndroidFrameFunc:
+ * @frame_time: monotonic time of the frame, in microseconds
+ * @presentation_time: monotonic time the frame is expected to be presented
+ *   at, in microseconds
+ * @n_skipped: the number of frames skipped since the previous one
+ * @user_data: data passed to g_source_set_callback()
+ *
+ * Callback of the sources created with g_android_frame_source_new().
+ *
+ * Returns: %FALSE if the source should be removed
+ */
+typedef gboolean (* GAndroidFrameFunc)  (gint64              frame_time,
+                                         gint64              presentation_time,
+                                         guint               n_skipped,
+                                         gpointer            user_data);
+
+/**
+ * GAndroidPollBackend:
+ * @G_ANDROID_POLL_BACKEND_IDENT: fds are registered with an ident and
+ *   reported one per ALooper_pollAll() call
+ * @G_ANDROID_POLL_BACKEND_CALLBACK: fds are registered with a callback and
+ *   all the ready ones are recorded by a single ALooper_pollOnce() call
+ *
+ * How g_android_attach_context_with_backend() registers fds with the looper.
+ */
+typedef enum
+{
+  G_ANDROID_POLL_BACKEND_IDENT,
+  G_ANDROID_POLL_BACKEND_CALLBACK
+} GAndroidPollBackend;
+
+/**
+ * GAndroidTimerSlackStats:
+ * @n_timer_polls: polls with a timeout
+ * @n_aligned: polls whose deadline has been pushed back to a tick of the
+ *   slack grid
+ * @n_timer_wakeups: polls that ran until their deadline
+ * @n_wakeups_saved: wakeups that would have been separate without slack: an
+ *   fd woke the poll up after its original deadline, or another context had
+ *   already woken up at the same tick
+ *
+ * Counters of the timer slack policy, see g_android_set_timer_slack().
+ */
+typedef struct
+{
+  guint n_timer_polls;
+  guint n_aligned;
+  guint n_timer_wakeups;
+  guint n_wakeups_saved;
+} GAndroidTimerSlackStats;
+
+/* Number of buckets of the latency histogram of GAndroidLoopStats */
+#define G_ANDROID_LOOP_STATS_N_BUCKETS  20
+
+/**
+ * GAndroidLoopStats:
+ * @n_polls: number of polls
+ * @n_add_fd: number of fds added to the looper, or updated
+ * @n_remove_fd: number of fds removed from the looper
+ * @n_wakeups_main: polls woken up by android_native_app_glue commands
+ * @n_wakeups_input: polls woken up by input events
+ * @n_wakeups_fd: polls woken up by the fds of GLib and of sources such as
+ *   the sensor sources
+ * @n_wakeups_timeout: polls that reached their timeout
+ * @n_wakeups_wake: polls woken up by ALooper_wake(), eg. from
+ *   g_android_context_wakeup()
+ * @blocked_time: time spent waiting in the looper, in microseconds
+ * @glue_time: time spent processing commands and input events inline, in
+ *   microseconds
+ * @latency: histogram of the time between the looper waking the poll up and
+ *   the poll returning to GLib: latency[0] counts latencies under 1us,
+ *   latency[i] the ones in [2^(i-1), 2^i) microseconds and the last bucket
+ *   all the longer ones
+ *
+ * Statistics of the polls of a context, see g_android_get_loop_stats().
+ */
+typedef struct
+{
+  guint64 n_polls;
+  guint64 n_add_fd;
+  guint64 n_remove_fd;
+
+  guint64 n_wakeups_main;
+  guint64 n_wakeups_input;
+  guint64 n_wakeups_fd;
+  guint64 n_wakeups_timeout;
+  guint64 n_wakeups_wake;
+
+  guint64 blocked_time;
+  guint64 glue_time;
+
+  guint32 latency[G_ANDROID_LOOP_STATS_N_BUCKETS];
+} GAndroidLoopStats;
+
+/* Number of profiles kept by g_android_get_dispatch_profiles() */
+#define G_ANDROID_N_DISPATCH_PROFILES   32
+
+/* Number of dispatches kept by g_android_get_slowest_dispatches() */
+#define G_ANDROID_N_SLOWEST_DISPATCHES  16
+
+/**
+ * GAndroidDispatchProfile:
+ * @name: the name of the sources, or their type for unnamed GLib sources,
+ *   "Unprofiled sources" for the sources that aren't set profiled
+ * @n_dispatches: number of dispatches
+ * @total_time: time spent dispatching, in microseconds
+ * @max_time: longest dispatch, in microseconds
+ *
+ * Dispatch profile of the sources with the same name, see
+ * g_android_get_dispatch_profiles().
+ */
+typedef struct
+{
+  const gchar *name;
+  guint64 n_dispatches;
+  guint64 total_time;
+  guint64 max_time;
+} GAndroidDispatchProfile;
+
+/**
+ * GAndroidSlowDispatch:
+ * @name: the name of the source, as in #GAndroidDispatchProfile
+ * @time: monotonic time the dispatch started at, in microseconds
+ * @duration: duration of the dispatch, in microseconds
+ *
+ * A dispatch recorded by g_android_get_slowest_dispatches().
+ */
+typedef struct
+{
+  const gchar *name;
+  gint64 time;
+  guint64 duration;
+} GAndroidSlowDispatch;
+
+/**
+ * GAndroidLogOverflow:
+ * @G_ANDROID_LOG_OVERFLOW_DROP_OLDEST: drop the oldest message to make room
+ * @G_ANDROID_LOG_OVERFLOW_BLOCK: wait for the writer thread to make room
+ *
+ * What the asynchronous log handler does when its ring is full, see
+ * g_android_log_set_async().
+ */
+typedef enum
+{
+  G_ANDROID_LOG_OVERFLOW_DROP_OLDEST,
+  G_ANDROID_LOG_OVERFLOW_BLOCK
+} GAndroidLogOverflow;
+
+/**
+ * GAndroidLogStats:
+ * @n_queued: messages queued for the writer thread in asynchronous mode
+ * @n_dropped: queued messages dropped because the ring was full
+ * @n_rate_limited: messages dropped by their rate limit
+ * @n_repeated: messages dropped as repeats of the previous one
+ *
+ * Counters of the log handler, see g_android_log_get_stats().
+ */
+typedef struct
+{
+  guint n_queued;
+  guint n_dropped;
+  guint n_rate_limited;
+  guint n_repeated;
+} GAndroidLogStats;
+
+#if GLIB_CHECK_VERSION (2, 50, 0)
+/**
+ * GAndroidLogFieldSink:
+ * @data: the encoded fields
+ * @size: the size of @data, in bytes
+ * @user_data: data passed to g_android_log_set_field_sink()
+ *
+ * Receives the fields of a structured log message, see
+ * g_android_log_set_field_sink(). @data holds the monotonic time of the
+ * message in microseconds and its #GLogLevelFlags, followed by the key and
+ * the value of each field, both prefixed by their length. All the numbers
+ * are encoded as LEB128 varints: 7 bits per byte, least significant first,
+ * the high bit set on all the bytes but the last. Fields that don't fit in
+ * 4096 bytes are left out.
+ */
+typedef void (* GAndroidLogFieldSink) (const guint8 *data,
+                                       gsize         size,
+                                       gpointer      user_data);
+#endif
+
+/* Default budget for the processing of android_native_app_glue commands and
+ * input events in a single poll, see g_android_set_glue_budget() */
+#define G_ANDROID_GLUE_DEFAULT_MAX_EVENTS       32
+#define G_ANDROID_GLUE_DEFAULT_MAX_TIME         4000    /* us */
+
+gboolean            g_android_init                           (void);
+
+gboolean            g_android_log_set_async                  (gboolean                 async,
+                                                              guint                    n_records,
+                                                              GAndroidLogOverflow      overflow);
+void                g_android_log_flush                      (void);
+void                g_android_log_get_stats                  (GAndroidLogStats        *stats);
+void                g_android_log_set_threshold              (const gchar             *log_domain,
+                                                              GLogLevelFlags           log_level);
+gboolean            g_android_log_is_enabled                 (const gchar             *log_domain,
+                                                              GLogLevelFlags           log_level);
+void                g_android_log_set_rate_limit             (const gchar             *log_domain,
+                                                              guint                    rate,
+                                                              guint                    burst);
+void                g_android_log_set_collapse_repeats       (gboolean                 collapse);
+gboolean            g_android_log_set_trace_file             (const gchar             *filename,
+                                                              guint                    n_records,
+                                                              GError                 **error);
+#if GLIB_CHECK_VERSION (2, 50, 0)
+GLogWriterOutput    g_android_log_writer                     (GLogLevelFlags           log_level,
+                                                              const GLogField         *fields,
+                                                              gsize                    n_fields,
+                                                              gpointer                 user_data);
+void                g_android_log_set_field_sink             (GAndroidLogFieldSink     sink,
+                                                              gpointer                 user_data);
+#endif
+gboolean            g_android_attach_context                 (GMainContext            *context);
+gboolean            g_android_attach_context_with_backend    (GMainContext            *context,
+                                                              GAndroidPollBackend      backend);
+void                g_android_context_wakeup                 (GMainContext            *context);
+
+void                g_android_set_glue_budget                (guint                    max_events,
+                                                              guint                    max_time);
+
+gboolean            g_android_set_timer_slack                (GMainContext            *context,
+                                                              guint                    slack);
+void                g_android_get_timer_slack_stats          (GMainContext            *context,
+                                                              GAndroidTimerSlackStats *stats);
+
+void                g_android_get_loop_stats                 (GMainContext            *context,
+                                                              GAndroidLoopStats       *stats);
+void                g_android_reset_loop_stats               (GMainContext            *context);
+
+gboolean            g_android_set_background_slack           (GMainContext            *context,
+                                                              guint                    slack);
+gboolean            g_android_set_background_priority        (GMainContext            *context,
+                                                              gint                     priority);
+gboolean            g_android_activity_is_paused             (void);
+
+gboolean            g_android_set_dispatch_profiling         (GMainContext            *context,
+                                                              gboolean                 enabled);
+void                g_android_source_set_profiled            (GSource                 *source,
+                                                              gboolean                 profiled);
+guint               g_android_get_dispatch_profiles          (GMainContext            *context,
+                                                              GAndroidDispatchProfile *profiles,
+                                                              guint                    n_profiles);
+guint               g_android_get_slowest_dispatches         (GMainContext            *context,
+                                                              GAndroidSlowDispatch    *dispatches,
+                                                              guint                    n_dispatches);
+void                g_android_reset_dispatch_profiles        (GMainContext            *context);
+void                g_android_dump_dispatch_profiles         (GMainContext            *context,
+                                                              guint                    n_profiles);
+
+GSource *           g_android_app_source_new                 (struct android_app      *app);
+GSource *           g_android_input_source_new               (struct android_app      *app);
+GSource *           g_android_input_batch_source_new         (struct android_app      *app,
+                                                              GAndroidInputBatchFlags  flags);
+
+GSource *           g_android_sensor_source_new              (ASensorManager          *manager,
+                                                              guint                    max_events);
+ASensorEventQueue * g_android_sensor_source_get_queue        (GSource                 *source);
+void                g_android_sensor_source_set_latency      (GSource                 *source,
+                                                              guint                    latency);
+
+GSource *           g_android_frame_source_new               (guint                    interval);
+
+/**
+ * g_android_debug:
+ * @...: format string, followed by parameters to insert into the format
+ *   string
+ *
+ * Like g_debug(), without formatting the message when it would be dropped,
+ * see g_android_log_set_threshold().
+ */
+#define g_android_debug(...)                                            \
+  G_STMT_START {                                                        \
+    if (g_android_log_is_enabled (G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG))     \
+      g_debug (__VA_ARGS__);                                            \
+  } G_STMT_END
 
 #endif /* __GLIB_ANDROID_H__ */
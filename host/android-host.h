@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * Host-only helpers to drive the NDK stand-ins: create a fake android_app on
+ * the calling thread, send it APP_CMD_* commands and inject input events the
+ * way the activity thread would on a device.
+ */
+
+#ifndef __ANDROID_HOST_H__
+#define __ANDROID_HOST_H__
+
+#include <stdint.h>
+
+#include <android/input.h>
+#include <android/looper.h>
+#include <android/sensor.h>
+
+#include <android_native_app_glue.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of syscalls issued by a looper */
+typedef struct
+{
+  uint64_t n_epoll_ctl;
+  uint64_t n_epoll_wait;
+} AndroidHostLooperStats;
+
+void                 android_host_looper_get_stats           (ALooper                *looper,
+                                                              AndroidHostLooperStats *stats);
+
+/* Receives the messages written to liblog instead of stderr, tag may be
+ * NULL */
+typedef void (* AndroidHostLogFunc) (int         prio,
+                                     const char *tag,
+                                     const char *text,
+                                     void       *user_data);
+
+void                 android_host_log_set_func               (AndroidHostLogFunc      func,
+                                                              void                   *user_data);
+
+AInputQueue *        android_host_input_queue_new            (void);
+void                 android_host_input_queue_free           (AInputQueue *queue);
+void                 android_host_input_queue_push_key       (AInputQueue *queue,
+                                                              int32_t      device_id,
+                                                              int32_t      action,
+                                                              int32_t      key_code);
+void                 android_host_input_queue_push_motion    (AInputQueue *queue,
+                                                              int32_t      device_id,
+                                                              int32_t      action,
+                                                              int32_t      pointer_id,
+                                                              float        x,
+                                                              float        y);
+int32_t              android_host_input_queue_get_n_finished (AInputQueue *queue);
+
+void                 android_host_sensor_event_queue_push    (ASensorEventQueue  *queue,
+                                                              const ASensorEvent *event);
+
+struct android_app * android_host_app_new                    (void);
+void                 android_host_app_free                   (struct android_app *app);
+void                 android_host_app_send_cmd               (struct android_app *app,
+                                                              int8_t              cmd);
+void                 android_host_app_set_input_queue        (struct android_app *app,
+                                                              AInputQueue        *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ANDROID_HOST_H__ */
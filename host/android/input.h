@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * Host stand-in for the NDK's <android/input.h>, limited to key and motion
+ * events. Events are injected with the helpers of android-host.h.
+ */
+
+#ifndef __ANDROID_INPUT_H__
+#define __ANDROID_INPUT_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <android/looper.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    AINPUT_EVENT_TYPE_KEY = 1,
+    AINPUT_EVENT_TYPE_MOTION = 2
+};
+
+enum {
+    AKEY_EVENT_ACTION_DOWN = 0,
+    AKEY_EVENT_ACTION_UP = 1,
+    AKEY_EVENT_ACTION_MULTIPLE = 2
+};
+
+enum {
+    AMOTION_EVENT_ACTION_MASK = 0xff,
+    AMOTION_EVENT_ACTION_POINTER_INDEX_MASK  = 0xff00,
+    AMOTION_EVENT_ACTION_DOWN = 0,
+    AMOTION_EVENT_ACTION_UP = 1,
+    AMOTION_EVENT_ACTION_MOVE = 2,
+    AMOTION_EVENT_ACTION_CANCEL = 3,
+    AMOTION_EVENT_ACTION_OUTSIDE = 4,
+    AMOTION_EVENT_ACTION_POINTER_DOWN = 5,
+    AMOTION_EVENT_ACTION_POINTER_UP = 6,
+};
+
+struct AInputEvent;
+typedef struct AInputEvent AInputEvent;
+
+int32_t AInputEvent_getType(const AInputEvent* event);
+int32_t AInputEvent_getDeviceId(const AInputEvent* event);
+int32_t AInputEvent_getSource(const AInputEvent* event);
+
+int32_t AKeyEvent_getAction(const AInputEvent* key_event);
+int32_t AKeyEvent_getKeyCode(const AInputEvent* key_event);
+int64_t AKeyEvent_getEventTime(const AInputEvent* key_event);
+
+int32_t AMotionEvent_getAction(const AInputEvent* motion_event);
+int64_t AMotionEvent_getEventTime(const AInputEvent* motion_event);
+size_t AMotionEvent_getPointerCount(const AInputEvent* motion_event);
+int32_t AMotionEvent_getPointerId(const AInputEvent* motion_event,
+                                  size_t pointer_index);
+float AMotionEvent_getX(const AInputEvent* motion_event, size_t pointer_index);
+float AMotionEvent_getY(const AInputEvent* motion_event, size_t pointer_index);
+
+struct AInputQueue;
+typedef struct AInputQueue AInputQueue;
+
+void AInputQueue_attachLooper(AInputQueue* queue, ALooper* looper,
+                              int ident, ALooper_callbackFunc callback,
+                              void* data);
+void AInputQueue_detachLooper(AInputQueue* queue);
+int32_t AInputQueue_hasEvents(AInputQueue* queue);
+int32_t AInputQueue_getEvent(AInputQueue* queue, AInputEvent** outEvent);
+int32_t AInputQueue_preDispatchEvent(AInputQueue* queue, AInputEvent* event);
+void AInputQueue_finishEvent(AInputQueue* queue, AInputEvent* event,
+                             int handled);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ANDROID_INPUT_H__ */
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * android_native_app_glue stand-in for host builds. There is no activity
+ * thread on the host: the android_app lives on the thread that creates it,
+ * which gets an ALooper with the command pipe registered as LOOPER_ID_MAIN,
+ * and commands are sent with android_host_app_send_cmd(). The processing of
+ * commands and input events mirrors the NDK's glue.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <android_native_app_glue.h>
+
+#include "android-host.h"
+
+int8_t
+android_app_read_cmd (struct android_app *android_app)
+{
+  int8_t cmd;
+
+  if (read (android_app->msgread, &cmd, sizeof (cmd)) != sizeof (cmd))
+    return -1;
+
+  return cmd;
+}
+
+void
+android_app_pre_exec_cmd (struct android_app *android_app,
+                          int8_t              cmd)
+{
+  switch (cmd)
+    {
+    case APP_CMD_INPUT_CHANGED:
+      pthread_mutex_lock (&android_app->mutex);
+      if (android_app->inputQueue != NULL)
+        AInputQueue_detachLooper (android_app->inputQueue);
+      android_app->inputQueue = android_app->pendingInputQueue;
+      if (android_app->inputQueue != NULL)
+        AInputQueue_attachLooper (android_app->inputQueue,
+                                  android_app->looper, LOOPER_ID_INPUT, NULL,
+                                  &android_app->inputPollSource);
+      pthread_cond_broadcast (&android_app->cond);
+      pthread_mutex_unlock (&android_app->mutex);
+      break;
+
+    case APP_CMD_INIT_WINDOW:
+      pthread_mutex_lock (&android_app->mutex);
+      android_app->window = android_app->pendingWindow;
+      pthread_cond_broadcast (&android_app->cond);
+      pthread_mutex_unlock (&android_app->mutex);
+      break;
+
+    case APP_CMD_TERM_WINDOW:
+      pthread_cond_broadcast (&android_app->cond);
+      break;
+
+    case APP_CMD_RESUME:
+    case APP_CMD_START:
+    case APP_CMD_PAUSE:
+    case APP_CMD_STOP:
+      pthread_mutex_lock (&android_app->mutex);
+      android_app->activityState = cmd;
+      pthread_cond_broadcast (&android_app->cond);
+      pthread_mutex_unlock (&android_app->mutex);
+      break;
+
+    case APP_CMD_DESTROY:
+      android_app->destroyRequested = 1;
+      break;
+
+    default:
+      break;
+    }
+}
+
+void
+android_app_post_exec_cmd (struct android_app *android_app,
+                           int8_t              cmd)
+{
+  switch (cmd)
+    {
+    case APP_CMD_TERM_WINDOW:
+      pthread_mutex_lock (&android_app->mutex);
+      android_app->window = NULL;
+      pthread_cond_broadcast (&android_app->cond);
+      pthread_mutex_unlock (&android_app->mutex);
+      break;
+
+    case APP_CMD_SAVE_STATE:
+      pthread_mutex_lock (&android_app->mutex);
+      android_app->stateSaved = 1;
+      pthread_cond_broadcast (&android_app->cond);
+      pthread_mutex_unlock (&android_app->mutex);
+      break;
+
+    case APP_CMD_RESUME:
+      free (android_app->savedState);
+      android_app->savedState = NULL;
+      android_app->savedStateSize = 0;
+      break;
+
+    default:
+      break;
+    }
+}
+
+void
+app_dummy (void)
+{
+}
+
+static void
+process_cmd (struct android_app         *app,
+             struct android_poll_source *source)
+{
+  int8_t cmd = android_app_read_cmd (app);
+
+  android_app_pre_exec_cmd (app, cmd);
+  if (app->onAppCmd != NULL)
+    app->onAppCmd (app, cmd);
+  android_app_post_exec_cmd (app, cmd);
+}
+
+static void
+process_input (struct android_app         *app,
+               struct android_poll_source *source)
+{
+  AInputEvent *event = NULL;
+
+  if (AInputQueue_getEvent (app->inputQueue, &event) >= 0)
+    {
+      int32_t handled = 0;
+
+      if (AInputQueue_preDispatchEvent (app->inputQueue, event))
+        return;
+
+      if (app->onInputEvent != NULL)
+        handled = app->onInputEvent (app, event);
+      AInputQueue_finishEvent (app->inputQueue, event, handled);
+    }
+}
+
+struct android_app *
+android_host_app_new (void)
+{
+  struct android_app *app;
+  int msgpipe[2];
+
+  if (pipe (msgpipe) < 0)
+    return NULL;
+
+  fcntl (msgpipe[0], F_SETFD, FD_CLOEXEC);
+  fcntl (msgpipe[1], F_SETFD, FD_CLOEXEC);
+
+  app = calloc (1, sizeof (struct android_app));
+  pthread_mutex_init (&app->mutex, NULL);
+  pthread_cond_init (&app->cond, NULL);
+  app->msgread = msgpipe[0];
+  app->msgwrite = msgpipe[1];
+  app->thread = pthread_self ();
+
+  app->cmdPollSource.id = LOOPER_ID_MAIN;
+  app->cmdPollSource.app = app;
+  app->cmdPollSource.process = process_cmd;
+  app->inputPollSource.id = LOOPER_ID_INPUT;
+  app->inputPollSource.app = app;
+  app->inputPollSource.process = process_input;
+
+  app->looper = ALooper_prepare (ALOOPER_PREPARE_ALLOW_NON_CALLBACKS);
+  ALooper_addFd (app->looper, app->msgread, LOOPER_ID_MAIN,
+                 ALOOPER_EVENT_INPUT, NULL, &app->cmdPollSource);
+
+  app->running = 1;
+
+  return app;
+}
+
+void
+android_host_app_free (struct android_app *app)
+{
+  if (app->inputQueue != NULL)
+    AInputQueue_detachLooper (app->inputQueue);
+
+  ALooper_removeFd (app->looper, app->msgread);
+
+  close (app->msgread);
+  close (app->msgwrite);
+  pthread_cond_destroy (&app->cond);
+  pthread_mutex_destroy (&app->mutex);
+  free (app->savedState);
+  free (app);
+}
+
+void
+android_host_app_send_cmd (struct android_app *app,
+                           int8_t              cmd)
+{
+  while (write (app->msgwrite, &cmd, sizeof (cmd)) < 0 && errno == EINTR)
+    ;
+}
+
+void
+android_host_app_set_input_queue (struct android_app *app,
+                                  AInputQueue        *queue)
+{
+  pthread_mutex_lock (&app->mutex);
+  app->pendingInputQueue = queue;
+  pthread_mutex_unlock (&app->mutex);
+
+  android_host_app_send_cmd (app, APP_CMD_INPUT_CHANGED);
+}
@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * AInputQueue stand-in for host builds. Events are injected with
+ * android_host_input_queue_push_*() and the queue is signalled to the looper
+ * through a pipe holding one byte per pending event.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <android/input.h>
+
+#include "android-host.h"
+
+struct AInputEvent
+{
+  AInputEvent *next;
+
+  int32_t type;
+  int32_t device_id;
+  int32_t action;
+  int32_t key_code;
+  int64_t event_time;
+
+  int32_t pointer_id;
+  float x, y;
+};
+
+struct AInputQueue
+{
+  pthread_mutex_t mutex;
+  AInputEvent *head, *tail;
+
+  int read_fd, write_fd;
+  ALooper *looper;
+
+  int32_t n_finished;
+};
+
+static int64_t
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int32_t
+AInputEvent_getType (const AInputEvent *event)
+{
+  return event->type;
+}
+
+int32_t
+AInputEvent_getDeviceId (const AInputEvent *event)
+{
+  return event->device_id;
+}
+
+int32_t
+AInputEvent_getSource (const AInputEvent *event)
+{
+  return 0;
+}
+
+int32_t
+AKeyEvent_getAction (const AInputEvent *key_event)
+{
+  return key_event->action;
+}
+
+int32_t
+AKeyEvent_getKeyCode (const AInputEvent *key_event)
+{
+  return key_event->key_code;
+}
+
+int64_t
+AKeyEvent_getEventTime (const AInputEvent *key_event)
+{
+  return key_event->event_time;
+}
+
+int32_t
+AMotionEvent_getAction (const AInputEvent *motion_event)
+{
+  return motion_event->action;
+}
+
+int64_t
+AMotionEvent_getEventTime (const AInputEvent *motion_event)
+{
+  return motion_event->event_time;
+}
+
+size_t
+AMotionEvent_getPointerCount (const AInputEvent *motion_event)
+{
+  return 1;
+}
+
+int32_t
+AMotionEvent_getPointerId (const AInputEvent *motion_event,
+                           size_t             pointer_index)
+{
+  return motion_event->pointer_id;
+}
+
+float
+AMotionEvent_getX (const AInputEvent *motion_event,
+                   size_t             pointer_index)
+{
+  return motion_event->x;
+}
+
+float
+AMotionEvent_getY (const AInputEvent *motion_event,
+                   size_t             pointer_index)
+{
+  return motion_event->y;
+}
+
+void
+AInputQueue_attachLooper (AInputQueue          *queue,
+                          ALooper              *looper,
+                          int                   ident,
+                          ALooper_callbackFunc  callback,
+                          void                 *data)
+{
+  queue->looper = looper;
+  ALooper_addFd (looper, queue->read_fd, ident, ALOOPER_EVENT_INPUT,
+                 callback, data);
+}
+
+void
+AInputQueue_detachLooper (AInputQueue *queue)
+{
+  if (queue->looper == NULL)
+    return;
+
+  ALooper_removeFd (queue->looper, queue->read_fd);
+  queue->looper = NULL;
+}
+
+int32_t
+AInputQueue_hasEvents (AInputQueue *queue)
+{
+  int32_t has_events;
+
+  pthread_mutex_lock (&queue->mutex);
+  has_events = queue->head != NULL;
+  pthread_mutex_unlock (&queue->mutex);
+
+  return has_events;
+}
+
+int32_t
+AInputQueue_getEvent (AInputQueue  *queue,
+                      AInputEvent **outEvent)
+{
+  AInputEvent *event;
+  char byte;
+
+  pthread_mutex_lock (&queue->mutex);
+
+  event = queue->head;
+  if (event)
+    {
+      queue->head = event->next;
+      if (queue->head == NULL)
+        queue->tail = NULL;
+
+      while (read (queue->read_fd, &byte, 1) < 0 && errno == EINTR)
+        ;
+    }
+
+  pthread_mutex_unlock (&queue->mutex);
+
+  if (event == NULL)
+    return -1;
+
+  event->next = NULL;
+  *outEvent = event;
+
+  return 0;
+}
+
+int32_t
+AInputQueue_preDispatchEvent (AInputQueue *queue,
+                              AInputEvent *event)
+{
+  /* There is no IME on the host to pre-dispatch events to */
+  return 0;
+}
+
+void
+AInputQueue_finishEvent (AInputQueue *queue,
+                         AInputEvent *event,
+                         int          handled)
+{
+  __sync_add_and_fetch (&queue->n_finished, 1);
+  free (event);
+}
+
+AInputQueue *
+android_host_input_queue_new (void)
+{
+  AInputQueue *queue;
+  int fds[2];
+
+  if (pipe (fds) < 0)
+    return NULL;
+
+  fcntl (fds[0], F_SETFL, O_NONBLOCK);
+  fcntl (fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl (fds[1], F_SETFD, FD_CLOEXEC);
+
+  queue = calloc (1, sizeof (AInputQueue));
+  pthread_mutex_init (&queue->mutex, NULL);
+  queue->read_fd = fds[0];
+  queue->write_fd = fds[1];
+
+  return queue;
+}
+
+void
+android_host_input_queue_free (AInputQueue *queue)
+{
+  AInputEvent *event, *next;
+
+  AInputQueue_detachLooper (queue);
+
+  for (event = queue->head; event; event = next)
+    {
+      next = event->next;
+      free (event);
+    }
+
+  close (queue->read_fd);
+  close (queue->write_fd);
+  pthread_mutex_destroy (&queue->mutex);
+  free (queue);
+}
+
+static void
+input_queue_push (AInputQueue *queue,
+                  AInputEvent *event)
+{
+  char byte = 0;
+
+  event->event_time = now_ns ();
+
+  pthread_mutex_lock (&queue->mutex);
+
+  if (queue->tail)
+    queue->tail->next = event;
+  else
+    queue->head = event;
+  queue->tail = event;
+
+  while (write (queue->write_fd, &byte, 1) < 0 && errno == EINTR)
+    ;
+
+  pthread_mutex_unlock (&queue->mutex);
+}
+
+void
+android_host_input_queue_push_key (AInputQueue *queue,
+                                   int32_t      device_id,
+                                   int32_t      action,
+                                   int32_t      key_code)
+{
+  AInputEvent *event;
+
+  event = calloc (1, sizeof (AInputEvent));
+  event->type = AINPUT_EVENT_TYPE_KEY;
+  event->device_id = device_id;
+  event->action = action;
+  event->key_code = key_code;
+
+  input_queue_push (queue, event);
+}
+
+void
+android_host_input_queue_push_motion (AInputQueue *queue,
+                                      int32_t      device_id,
+                                      int32_t      action,
+                                      int32_t      pointer_id,
+                                      float        x,
+                                      float        y)
+{
+  AInputEvent *event;
+
+  event = calloc (1, sizeof (AInputEvent));
+  event->type = AINPUT_EVENT_TYPE_MOTION;
+  event->device_id = device_id;
+  event->action = action;
+  event->pointer_id = pointer_id;
+  event->x = x;
+  event->y = y;
+
+  input_queue_push (queue, event);
+}
+
+int32_t
+android_host_input_queue_get_n_finished (AInputQueue *queue)
+{
+  return __sync_add_and_fetch (&queue->n_finished, 0);
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * liblog stand-in for host builds: messages are written to stderr, prefixed
+ * with their priority and tag the way logcat prints them, or handed to the
+ * function set with android_host_log_set_func().
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <android/log.h>
+
+#include "android-host.h"
+
+static AndroidHostLogFunc log_func;
+static void *log_func_data;
+
+static char
+priority_to_char (int prio)
+{
+  static const char chars[] = "??VDIWEFS";
+
+  if (prio < 0 || prio > ANDROID_LOG_SILENT)
+    return '?';
+
+  return chars[prio];
+}
+
+int
+__android_log_write (int         prio,
+                     const char *tag,
+                     const char *text)
+{
+  if (log_func)
+    {
+      log_func (prio, tag, text, log_func_data);
+      return 1;
+    }
+
+  if (tag == NULL)
+    tag = "";
+
+  return fprintf (stderr, "%c/%s: %s\n", priority_to_char (prio), tag, text);
+}
+
+int
+__android_log_vprint (int         prio,
+                      const char *tag,
+                      const char *fmt,
+                      va_list     ap)
+{
+  char buffer[1024];
+
+  vsnprintf (buffer, sizeof (buffer), fmt, ap);
+
+  return __android_log_write (prio, tag, buffer);
+}
+
+int
+__android_log_print (int         prio,
+                     const char *tag,
+                     const char *fmt,
+                     ...)
+{
+  va_list ap;
+  int res;
+
+  va_start (ap, fmt);
+  res = __android_log_vprint (prio, tag, fmt, ap);
+  va_end (ap);
+
+  return res;
+}
+
+void
+android_host_log_set_func (AndroidHostLogFunc  func,
+                           void               *user_data)
+{
+  log_func = func;
+  log_func_data = user_data;
+}
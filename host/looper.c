@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * ALooper stand-in for host builds, implemented on top of epoll and eventfd.
+ * It follows the semantics of the Looper found in Android's libutils: one
+ * looper per thread, fds registered with an ident are returned by pollOnce()
+ * one at a time, fds registered with a callback have their callback invoked
+ * from pollOnce() which then returns ALOOPER_POLL_CALLBACK.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <android/looper.h>
+
+#include "android-host.h"
+
+/* Same value as Looper.cpp */
+#define EPOLL_MAX_EVENTS 16
+
+typedef struct
+{
+  int fd;
+  int ident;
+  int events;
+  ALooper_callbackFunc callback;
+  void *data;
+} Request;
+
+typedef struct
+{
+  int events;
+  Request request;
+} Response;
+
+struct ALooper
+{
+  int ref_count;
+  int allow_non_callbacks;
+
+  int epoll_fd;
+  int wake_fd;
+
+  /* registered fds, indexed by fd */
+  Request *requests;
+  int n_requests;
+
+  Response responses[EPOLL_MAX_EVENTS];
+  int n_responses;
+  int response_index;
+
+  AndroidHostLooperStats stats;
+};
+
+static pthread_once_t looper_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t looper_key;
+
+static void
+looper_unref (ALooper *looper)
+{
+  if (__sync_sub_and_fetch (&looper->ref_count, 1) > 0)
+    return;
+
+  close (looper->wake_fd);
+  close (looper->epoll_fd);
+  free (looper->requests);
+  free (looper);
+}
+
+static void
+looper_key_create (void)
+{
+  pthread_key_create (&looper_key, (void (*) (void *)) looper_unref);
+}
+
+static int64_t
+now_ms (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t
+looper_events_to_epoll (int events)
+{
+  uint32_t epoll_events = 0;
+
+  if (events & ALOOPER_EVENT_INPUT)
+    epoll_events |= EPOLLIN;
+
+  if (events & ALOOPER_EVENT_OUTPUT)
+    epoll_events |= EPOLLOUT;
+
+  return epoll_events;
+}
+
+static int
+epoll_events_to_looper (uint32_t epoll_events)
+{
+  int events = 0;
+
+  if (epoll_events & EPOLLIN)
+    events |= ALOOPER_EVENT_INPUT;
+
+  if (epoll_events & EPOLLOUT)
+    events |= ALOOPER_EVENT_OUTPUT;
+
+  if (epoll_events & EPOLLERR)
+    events |= ALOOPER_EVENT_ERROR;
+
+  if (epoll_events & EPOLLHUP)
+    events |= ALOOPER_EVENT_HANGUP;
+
+  return events;
+}
+
+static Request *
+looper_get_request (ALooper *looper,
+                    int      fd)
+{
+  if (fd < 0 || fd >= looper->n_requests || looper->requests[fd].fd != fd)
+    return NULL;
+
+  return &looper->requests[fd];
+}
+
+ALooper *
+ALooper_forThread (void)
+{
+  pthread_once (&looper_key_once, looper_key_create);
+
+  return pthread_getspecific (looper_key);
+}
+
+ALooper *
+ALooper_prepare (int opts)
+{
+  ALooper *looper;
+  struct epoll_event event;
+
+  looper = ALooper_forThread ();
+  if (looper)
+    return looper;
+
+  looper = calloc (1, sizeof (ALooper));
+  looper->ref_count = 1;
+  looper->allow_non_callbacks = opts & ALOOPER_PREPARE_ALLOW_NON_CALLBACKS;
+
+  looper->wake_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  looper->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+
+  memset (&event, 0, sizeof (event));
+  event.events = EPOLLIN;
+  event.data.fd = looper->wake_fd;
+  epoll_ctl (looper->epoll_fd, EPOLL_CTL_ADD, looper->wake_fd, &event);
+
+  pthread_setspecific (looper_key, looper);
+
+  return looper;
+}
+
+void
+ALooper_acquire (ALooper *looper)
+{
+  __sync_add_and_fetch (&looper->ref_count, 1);
+}
+
+void
+ALooper_release (ALooper *looper)
+{
+  looper_unref (looper);
+}
+
+static void
+looper_awoken (ALooper *looper)
+{
+  uint64_t counter;
+
+  while (read (looper->wake_fd, &counter, sizeof (counter)) < 0 &&
+         errno == EINTR)
+    ;
+}
+
+static int
+looper_poll_inner (ALooper *looper,
+                   int      timeout_ms)
+{
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+  int result = ALOOPER_POLL_WAKE;
+  int n_events, i;
+
+  looper->n_responses = 0;
+  looper->response_index = 0;
+
+  n_events = epoll_wait (looper->epoll_fd, events, EPOLL_MAX_EVENTS,
+                         timeout_ms);
+  looper->stats.n_epoll_wait++;
+
+  if (n_events < 0)
+    {
+      if (errno == EINTR)
+        return result;
+
+      return ALOOPER_POLL_ERROR;
+    }
+
+  if (n_events == 0)
+    return ALOOPER_POLL_TIMEOUT;
+
+  for (i = 0; i < n_events; i++)
+    {
+      int fd = events[i].data.fd;
+      Request *request;
+      Response *response;
+
+      if (fd == looper->wake_fd)
+        {
+          if (events[i].events & EPOLLIN)
+            looper_awoken (looper);
+          continue;
+        }
+
+      request = looper_get_request (looper, fd);
+      if (request == NULL)
+        continue;
+
+      response = &looper->responses[looper->n_responses++];
+      response->events = epoll_events_to_looper (events[i].events);
+      response->request = *request;
+    }
+
+  /* Invoke all the callbacks */
+  for (i = 0; i < looper->n_responses; i++)
+    {
+      Response *response = &looper->responses[i];
+
+      if (response->request.ident != ALOOPER_POLL_CALLBACK)
+        continue;
+
+      if (response->request.callback (response->request.fd, response->events,
+                                      response->request.data) == 0)
+        ALooper_removeFd (looper, response->request.fd);
+
+      result = ALOOPER_POLL_CALLBACK;
+    }
+
+  return result;
+}
+
+int
+ALooper_pollOnce (int    timeoutMillis,
+                  int   *outFd,
+                  int   *outEvents,
+                  void **outData)
+{
+  ALooper *looper = ALooper_forThread ();
+  int result = 0;
+
+  if (looper == NULL)
+    return ALOOPER_POLL_ERROR;
+
+  for (;;)
+    {
+      while (looper->response_index < looper->n_responses)
+        {
+          Response *response = &looper->responses[looper->response_index++];
+
+          if (response->request.ident >= 0)
+            {
+              if (outFd)
+                *outFd = response->request.fd;
+              if (outEvents)
+                *outEvents = response->events;
+              if (outData)
+                *outData = response->request.data;
+
+              return response->request.ident;
+            }
+        }
+
+      if (result != 0)
+        {
+          if (outFd)
+            *outFd = 0;
+          if (outEvents)
+            *outEvents = 0;
+          if (outData)
+            *outData = NULL;
+
+          return result;
+        }
+
+      result = looper_poll_inner (looper, timeoutMillis);
+    }
+}
+
+int
+ALooper_pollAll (int    timeoutMillis,
+                 int   *outFd,
+                 int   *outEvents,
+                 void **outData)
+{
+  int64_t end_time;
+  int result;
+
+  if (timeoutMillis <= 0)
+    {
+      do
+        result = ALooper_pollOnce (timeoutMillis, outFd, outEvents, outData);
+      while (result == ALOOPER_POLL_CALLBACK);
+
+      return result;
+    }
+
+  end_time = now_ms () + timeoutMillis;
+
+  for (;;)
+    {
+      result = ALooper_pollOnce (timeoutMillis, outFd, outEvents, outData);
+      if (result != ALOOPER_POLL_CALLBACK)
+        break;
+
+      timeoutMillis = end_time - now_ms ();
+      if (timeoutMillis <= 0)
+        {
+          result = ALOOPER_POLL_TIMEOUT;
+          break;
+        }
+    }
+
+  return result;
+}
+
+void
+ALooper_wake (ALooper *looper)
+{
+  uint64_t inc = 1;
+
+  while (write (looper->wake_fd, &inc, sizeof (inc)) < 0 && errno == EINTR)
+    ;
+}
+
+int
+ALooper_addFd (ALooper              *looper,
+               int                   fd,
+               int                   ident,
+               int                   events,
+               ALooper_callbackFunc  callback,
+               void                 *data)
+{
+  struct epoll_event event;
+  Request *request;
+  int op;
+
+  if (callback == NULL)
+    {
+      if (!looper->allow_non_callbacks || ident < 0)
+        return -1;
+    }
+  else
+    {
+      ident = ALOOPER_POLL_CALLBACK;
+    }
+
+  if (fd < 0)
+    return -1;
+
+  if (fd >= looper->n_requests)
+    {
+      int n_requests = looper->n_requests ? looper->n_requests : 64;
+      int i;
+
+      while (n_requests <= fd)
+        n_requests *= 2;
+
+      looper->requests = realloc (looper->requests,
+                                  n_requests * sizeof (Request));
+      for (i = looper->n_requests; i < n_requests; i++)
+        looper->requests[i].fd = -1;
+      looper->n_requests = n_requests;
+    }
+
+  memset (&event, 0, sizeof (event));
+  event.events = looper_events_to_epoll (events);
+  event.data.fd = fd;
+
+  request = &looper->requests[fd];
+  op = request->fd == fd ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+  looper->stats.n_epoll_ctl++;
+  if (epoll_ctl (looper->epoll_fd, op, fd, &event) < 0)
+    {
+      /* The fd may have been closed and its number reused before being
+       * removed from the looper, in which case it is not in the epoll set
+       * any more */
+      if (op == EPOLL_CTL_MOD && errno == ENOENT)
+        {
+          looper->stats.n_epoll_ctl++;
+          if (epoll_ctl (looper->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+            return -1;
+        }
+      else
+        {
+          return -1;
+        }
+    }
+
+  request->fd = fd;
+  request->ident = ident;
+  request->events = events;
+  request->callback = callback;
+  request->data = data;
+
+  return 1;
+}
+
+int
+ALooper_removeFd (ALooper *looper,
+                  int      fd)
+{
+  Request *request;
+
+  request = looper_get_request (looper, fd);
+  if (request == NULL)
+    return 0;
+
+  request->fd = -1;
+
+  /* The fd may already have been closed, which removes it from the epoll
+   * set */
+  looper->stats.n_epoll_ctl++;
+  if (epoll_ctl (looper->epoll_fd, EPOLL_CTL_DEL, fd, NULL) < 0 &&
+      errno != EBADF && errno != ENOENT)
+    return -1;
+
+  return 1;
+}
+
+void
+android_host_looper_get_stats (ALooper                *looper,
+                               AndroidHostLooperStats *stats)
+{
+  *stats = looper->stats;
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * ASensorEventQueue stand-in for host builds. There is no sensor hardware,
+ * events are injected with android_host_sensor_event_queue_push() and written
+ * as is to a pipe the queue registers with the looper. Writes of an event are
+ * atomic, so reading the pipe always gives whole events.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+
+#include <android/sensor.h>
+
+#include "android-host.h"
+
+struct ASensorManager
+{
+  int unused;
+};
+
+struct ASensor
+{
+  int type;
+  const char *name;
+  int min_delay;        /* us */
+};
+
+struct ASensorEventQueue
+{
+  ALooper *looper;
+  int read_fd, write_fd;
+};
+
+static ASensorManager manager;
+
+static const ASensor sensors[] =
+{
+  { ASENSOR_TYPE_ACCELEROMETER, "Host accelerometer", 10000 },
+  { ASENSOR_TYPE_MAGNETIC_FIELD, "Host magnetic field", 10000 },
+  { ASENSOR_TYPE_GYROSCOPE, "Host gyroscope", 10000 },
+  { ASENSOR_TYPE_LIGHT, "Host light", 0 },
+  { ASENSOR_TYPE_PROXIMITY, "Host proximity", 0 },
+};
+
+ASensorManager *
+ASensorManager_getInstance (void)
+{
+  return &manager;
+}
+
+ASensor const *
+ASensorManager_getDefaultSensor (ASensorManager *manager,
+                                 int             type)
+{
+  unsigned int i;
+
+  for (i = 0; i < sizeof (sensors) / sizeof (sensors[0]); i++)
+    if (sensors[i].type == type)
+      return &sensors[i];
+
+  return NULL;
+}
+
+ASensorEventQueue *
+ASensorManager_createEventQueue (ASensorManager       *manager,
+                                 ALooper              *looper,
+                                 int                   ident,
+                                 ALooper_callbackFunc  callback,
+                                 void                 *data)
+{
+  ASensorEventQueue *queue;
+  int fds[2];
+
+  if (pipe (fds) < 0)
+    return NULL;
+
+  fcntl (fds[0], F_SETFL, O_NONBLOCK);
+  fcntl (fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl (fds[1], F_SETFD, FD_CLOEXEC);
+
+  queue = calloc (1, sizeof (ASensorEventQueue));
+  queue->looper = looper;
+  queue->read_fd = fds[0];
+  queue->write_fd = fds[1];
+
+  ALooper_addFd (looper, queue->read_fd, ident, ALOOPER_EVENT_INPUT,
+                 callback, data);
+
+  return queue;
+}
+
+int
+ASensorManager_destroyEventQueue (ASensorManager    *manager,
+                                  ASensorEventQueue *queue)
+{
+  ALooper_removeFd (queue->looper, queue->read_fd);
+  close (queue->read_fd);
+  close (queue->write_fd);
+  free (queue);
+
+  return 0;
+}
+
+int
+ASensorEventQueue_enableSensor (ASensorEventQueue *queue,
+                                ASensor const     *sensor)
+{
+  return 0;
+}
+
+int
+ASensorEventQueue_disableSensor (ASensorEventQueue *queue,
+                                 ASensor const     *sensor)
+{
+  return 0;
+}
+
+int
+ASensorEventQueue_setEventRate (ASensorEventQueue *queue,
+                                ASensor const     *sensor,
+                                int32_t            usec)
+{
+  return 0;
+}
+
+int
+ASensorEventQueue_hasEvents (ASensorEventQueue *queue)
+{
+  int n_bytes = 0;
+
+  if (ioctl (queue->read_fd, FIONREAD, &n_bytes) < 0)
+    return -1;
+
+  return n_bytes >= (int) sizeof (ASensorEvent);
+}
+
+ssize_t
+ASensorEventQueue_getEvents (ASensorEventQueue *queue,
+                             ASensorEvent      *events,
+                             size_t             count)
+{
+  ssize_t res;
+
+  do
+    res = read (queue->read_fd, events, count * sizeof (ASensorEvent));
+  while (res < 0 && errno == EINTR);
+
+  if (res < 0)
+    return errno == EAGAIN ? 0 : -errno;
+
+  return res / sizeof (ASensorEvent);
+}
+
+const char *
+ASensor_getName (ASensor const *sensor)
+{
+  return sensor->name;
+}
+
+int
+ASensor_getType (ASensor const *sensor)
+{
+  return sensor->type;
+}
+
+int
+ASensor_getMinDelay (ASensor const *sensor)
+{
+  return sensor->min_delay;
+}
+
+void
+android_host_sensor_event_queue_push (ASensorEventQueue  *queue,
+                                      const ASensorEvent *event)
+{
+  ssize_t res;
+
+  do
+    res = write (queue->write_fd, event, sizeof (ASensorEvent));
+  while (res < 0 && errno == EINTR);
+}
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * Jitter benchmark of the frame source: compares g_android_frame_source_new()
+ * with a g_timeout_add() of the frame interval, the way the samples would pace
+ * their drawing without it.
+ *
+ * Each backend prints one JSON object per line on stdout, giving how late
+ * the ticks are dispatched compared to the grid of frames they should follow
+ * and how many frames were skipped. A timeout drifts away from the grid, so
+ * its lateness keeps on growing, "drift_us" is the lateness of its last tick.
+ * With --overrun, every Nth frame takes 1.5 frame intervals to draw.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <android-host.h>
+#include <glib-android.h>
+
+static gint n_frames = 300;
+static gint interval = 16667;
+static gint overrun_every;
+static gchar *only_backend;
+
+static GOptionEntry entries[] =
+{
+  { "frames", 'n', 0, G_OPTION_ARG_INT, &n_frames,
+    "Number of frames per backend (300)", "N" },
+  { "interval", 'i', 0, G_OPTION_ARG_INT, &interval,
+    "Frame interval in microseconds (16667)", "US" },
+  { "overrun", 'o', 0, G_OPTION_ARG_INT, &overrun_every,
+    "Overrun the frame interval every N frames (never)", "N" },
+  { "backend", 'b', 0, G_OPTION_ARG_STRING, &only_backend,
+    "Only benchmark this backend (frame or timeout)", "NAME" },
+  { NULL }
+};
+
+typedef struct
+{
+  gint64 start_time;            /* time of the tick before the first one */
+  gint64 *lateness;
+  gint n_ticks;
+  guint n_skipped;
+} BenchData;
+
+static void
+record_tick (BenchData *bench,
+             gint64     tick_time)
+{
+  bench->lateness[bench->n_ticks++] = g_get_monotonic_time () - tick_time;
+
+  if (overrun_every > 0 && bench->n_ticks % overrun_every == 0)
+    g_usleep (interval * 3 / 2);
+}
+
+static gboolean
+on_frame (gint64    frame_time,
+          gint64    presentation_time,
+          guint     n_skipped,
+          gpointer  user_data)
+{
+  BenchData *bench = user_data;
+
+  bench->n_skipped += n_skipped;
+  record_tick (bench, frame_time);
+
+  return TRUE;
+}
+
+static gboolean
+on_timeout (gpointer user_data)
+{
+  BenchData *bench = user_data;
+
+  /* the tick this one should have landed on */
+  record_tick (bench, bench->start_time + (bench->n_ticks + 1) * interval);
+
+  return TRUE;
+}
+
+static gint
+compare_samples (gconstpointer a,
+                 gconstpointer b)
+{
+  const gint64 *sa = a, *sb = b;
+
+  return (*sa > *sb) - (*sa < *sb);
+}
+
+static void
+bench_frames (const gchar *backend)
+{
+  BenchData bench;
+  GSource *source;
+  gint64 drift, sum = 0;
+  gint i;
+
+  memset (&bench, 0, sizeof (bench));
+  bench.lateness = g_new (gint64, n_frames);
+  bench.start_time = g_get_monotonic_time ();
+
+  if (strcmp (backend, "frame") == 0)
+    {
+      source = g_android_frame_source_new (interval);
+      g_source_set_callback (source, (GSourceFunc) on_frame, &bench, NULL);
+    }
+  else
+    {
+      source = g_timeout_source_new (interval / 1000);
+      g_source_set_callback (source, on_timeout, &bench, NULL);
+    }
+  g_source_attach (source, NULL);
+
+  while (bench.n_ticks < n_frames)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_source_destroy (source);
+  g_source_unref (source);
+
+  drift = bench.lateness[n_frames - 1];
+  for (i = 0; i < n_frames; i++)
+    sum += bench.lateness[i];
+  qsort (bench.lateness, n_frames, sizeof (gint64), compare_samples);
+
+  g_print ("{ \"bench\": \"frame\", \"backend\": \"%s\", "
+           "\"interval_us\": %d, \"frames\": %d, \"overrun_every\": %d, "
+           "\"skipped\": %u, \"mean_us\": %" G_GINT64_FORMAT ", "
+           "\"p50_us\": %" G_GINT64_FORMAT ", \"p99_us\": %" G_GINT64_FORMAT
+           ", \"max_us\": %" G_GINT64_FORMAT ", \"drift_us\": %"
+           G_GINT64_FORMAT " }\n",
+           backend, interval, n_frames, overrun_every, bench.n_skipped,
+           sum / n_frames,
+           bench.lateness[n_frames / 2],
+           bench.lateness[n_frames * 99 / 100],
+           bench.lateness[n_frames - 1],
+           drift);
+
+  g_free (bench.lateness);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  static const gchar *backends[] = { "frame", "timeout" };
+  GOptionContext *option_context;
+  GError *error = NULL;
+  guint b;
+
+  option_context = g_option_context_new ("- benchmark the frame source");
+  g_option_context_add_main_entries (option_context, entries, NULL);
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free (option_context);
+
+  if (n_frames <= 0 || interval < 1000)
+    {
+      g_printerr ("The number of frames has to be positive and the interval "
+                  "at least 1000us\n");
+      return EXIT_FAILURE;
+    }
+
+  ALooper_prepare (ALOOPER_PREPARE_ALLOW_NON_CALLBACKS);
+  g_android_init ();
+
+  for (b = 0; b < G_N_ELEMENTS (backends); b++)
+    {
+      if (only_backend && strcmp (only_backend, backends[b]) != 0)
+        continue;
+
+      bench_frames (backends[b]);
+    }
+
+  return EXIT_SUCCESS;
+}
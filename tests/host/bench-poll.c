@@ -0,0 +1,507 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * Benchmark of the poll path: compares g_android_poll(), on top of the
+ * ALooper stand-in and with both ways of registering fds, with GLib's stock
+ * g_poll() for a growing number of fds, ratios of ready fds and rates of
+ * sources coming and going.
+ *
+ * Each configuration prints one JSON object per line on stdout:
+ *  - "iteration" records give the cost of a non-blocking main loop iteration
+ *    and the number of syscalls it issues, whoever issues them: GLib, the
+ *    poll function or the looper, see syscall-count.c,
+ *  - "latency" records give the time between an fd being written to by
+ *    another thread and the main loop dispatching its source.
+ *
+ * Churn replaces sources by new ones watching freshly opened fds, which
+ * usually get the number of the fd that has just been closed, like a client
+ * reconnecting would.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+
+#include <android-host.h>
+#include <glib-android.h>
+
+#include "syscall-count.h"
+
+typedef struct
+{
+  const gchar *name;
+  GMainContext *context;
+} Backend;
+
+typedef struct
+{
+  GSource source;
+
+  GPollFD poll_fd;
+  guint64 *n_dispatched;
+} BenchSource;
+
+static gint max_fds = 10000;
+static gint n_samples = 200;
+static gchar *only_backend;
+
+static GOptionEntry entries[] =
+{
+  { "max-fds", 'n', 0, G_OPTION_ARG_INT, &max_fds,
+    "Maximum number of fds to benchmark (10000)", "N" },
+  { "samples", 's', 0, G_OPTION_ARG_INT, &n_samples,
+    "Number of latency samples per configuration (200)", "N" },
+  { "backend", 'b', 0, G_OPTION_ARG_STRING, &only_backend,
+    "Only benchmark this backend (android, android-callback or stock)",
+    "NAME" },
+  { NULL }
+};
+
+/* latency measurements, the producer thread writes the latency fd after
+ * having stored the time of the write */
+static gint64 latency_write_time;
+static gint64 *latency_samples;
+static gint n_latency_samples;
+static gint latency_fd = -1;
+
+static gboolean
+bench_source_prepare (GSource *source,
+                      gint    *timeout_)
+{
+  *timeout_ = -1;
+
+  return FALSE;
+}
+
+static gboolean
+bench_source_check (GSource *source)
+{
+  BenchSource *bench_source = (BenchSource *) source;
+
+  return bench_source->poll_fd.revents & G_IO_IN;
+}
+
+static gboolean
+bench_source_dispatch (GSource     *source,
+                       GSourceFunc  callback,
+                       gpointer     user_data)
+{
+  BenchSource *bench_source = (BenchSource *) source;
+
+  (*bench_source->n_dispatched)++;
+
+  if (bench_source->poll_fd.fd == latency_fd)
+    {
+      guint64 value;
+      gint64 now;
+
+      now = g_get_monotonic_time ();
+      if (read (latency_fd, &value, sizeof (value)) == sizeof (value))
+        latency_samples[n_latency_samples++] =
+          now - g_atomic_pointer_get (&latency_write_time);
+    }
+
+  return TRUE;
+}
+
+static GSourceFuncs bench_source_funcs =
+{
+  bench_source_prepare,
+  bench_source_check,
+  bench_source_dispatch,
+  NULL
+};
+
+static GSource *
+bench_source_new (GMainContext *context,
+                  gint          fd,
+                  guint64      *n_dispatched)
+{
+  BenchSource *bench_source;
+  GSource *source;
+
+  source = g_source_new (&bench_source_funcs, sizeof (BenchSource));
+  bench_source = (BenchSource *) source;
+  bench_source->poll_fd.fd = fd;
+  bench_source->poll_fd.events = G_IO_IN;
+  bench_source->n_dispatched = n_dispatched;
+  g_source_add_poll (source, &bench_source->poll_fd);
+  g_source_attach (source, context);
+
+  return source;
+}
+
+/*
+ * Backends
+ */
+
+static void
+backends_init (Backend *android,
+               Backend *android_callback,
+               Backend *stock)
+{
+  android->name = "android";
+  ALooper_prepare (ALOOPER_PREPARE_ALLOW_NON_CALLBACKS);
+  g_android_init ();
+  android->context = g_main_context_default ();
+
+  android_callback->name = "android-callback";
+  android_callback->context = g_main_context_new ();
+  g_android_attach_context_with_backend (android_callback->context,
+                                         G_ANDROID_POLL_BACKEND_CALLBACK);
+
+  stock->name = "stock";
+  stock->context = g_main_context_new ();
+}
+
+/*
+ * Benchmarks
+ */
+
+static gint *
+open_fds (guint n_fds)
+{
+  gint *fds;
+  guint i;
+
+  fds = g_new (gint, n_fds);
+  for (i = 0; i < n_fds; i++)
+    {
+      fds[i] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (fds[i] < 0)
+        g_error ("Could not create eventfd: %s", g_strerror (errno));
+    }
+
+  return fds;
+}
+
+static void
+close_fds (gint  *fds,
+           guint  n_fds)
+{
+  guint i;
+
+  for (i = 0; i < n_fds; i++)
+    close (fds[i]);
+  g_free (fds);
+}
+
+static void
+make_ready (gint fd)
+{
+  guint64 one = 1;
+
+  if (write (fd, &one, sizeof (one)) != sizeof (one))
+    g_error ("Could not write to eventfd: %s", g_strerror (errno));
+}
+
+static guint
+get_n_churn (guint   n_fds,
+             gdouble churn_ratio)
+{
+  guint n_churn;
+
+  n_churn = churn_ratio * n_fds;
+  if (churn_ratio > 0 && n_churn == 0)
+    n_churn = 1;
+
+  return n_churn;
+}
+
+/* Replaces n_churn sources, and their fds, by new ones */
+static void
+churn_sources (Backend  *backend,
+               GSource **sources,
+               gint     *fds,
+               guint     n_fds,
+               guint     n_churn,
+               guint    *next_churn,
+               guint     n_ready,
+               guint64  *n_dispatched)
+{
+  guint i;
+
+  for (i = 0; i < n_churn; i++)
+    {
+      guint k = (*next_churn)++ % n_fds;
+
+      g_source_destroy (sources[k]);
+      g_source_unref (sources[k]);
+      close (fds[k]);
+
+      fds[k] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (fds[k] < 0)
+        g_error ("Could not create eventfd: %s", g_strerror (errno));
+      if (k < n_ready)
+        make_ready (fds[k]);
+      sources[k] = bench_source_new (backend->context, fds[k], n_dispatched);
+    }
+}
+
+static void
+bench_iterations (Backend *backend,
+                  guint    n_fds,
+                  gdouble  ready_ratio,
+                  gdouble  churn_ratio)
+{
+  GSource **sources;
+  guint64 n_dispatched = 0, n_syscalls = 0;
+  guint i, n_ready, n_churn, n_iterations, next_churn = 0;
+  gint64 start, elapsed;
+  gint *fds;
+
+  n_iterations = CLAMP (200000 / n_fds, 20, 2000);
+  n_ready = ready_ratio * n_fds;
+  if (ready_ratio > 0 && n_ready == 0)
+    n_ready = 1;
+  n_churn = get_n_churn (n_fds, churn_ratio);
+
+  fds = open_fds (n_fds);
+  sources = g_new (GSource *, n_fds);
+  for (i = 0; i < n_fds; i++)
+    {
+      sources[i] = bench_source_new (backend->context, fds[i], &n_dispatched);
+      if (i < n_ready)
+        make_ready (fds[i]);
+    }
+
+  /* warm up */
+  for (i = 0; i < 10; i++)
+    g_main_context_iteration (backend->context, FALSE);
+
+  start = g_get_monotonic_time ();
+
+  for (i = 0; i < n_iterations; i++)
+    {
+      churn_sources (backend, sources, fds, n_fds, n_churn, &next_churn,
+                     n_ready, &n_dispatched);
+      syscall_count_begin ();
+      g_main_context_iteration (backend->context, FALSE);
+      n_syscalls += syscall_count_end ();
+    }
+
+  elapsed = g_get_monotonic_time () - start;
+
+  g_print ("{ \"bench\": \"iteration\", \"backend\": \"%s\", "
+           "\"n_fds\": %u, \"ready_ratio\": %g, \"churn_ratio\": %g, "
+           "\"iterations\": %u, \"ns_per_iteration\": %.0f, "
+           "\"syscalls_per_iteration\": %.2f }\n",
+           backend->name, n_fds, ready_ratio, churn_ratio, n_iterations,
+           elapsed * 1000. / n_iterations, (gdouble) n_syscalls / n_iterations);
+
+  for (i = 0; i < n_fds; i++)
+    {
+      g_source_destroy (sources[i]);
+      g_source_unref (sources[i]);
+    }
+  g_free (sources);
+  close_fds (fds, n_fds);
+
+  /* let the poll function forget about the fds */
+  g_main_context_iteration (backend->context, FALSE);
+}
+
+static gpointer
+latency_producer (gpointer data)
+{
+  gint i;
+
+  for (i = 0; i < n_samples; i++)
+    {
+      g_usleep (500);
+      g_atomic_pointer_set (&latency_write_time, g_get_monotonic_time ());
+      make_ready (latency_fd);
+
+      /* wait for the sample to be consumed */
+      while (g_atomic_int_get (&n_latency_samples) <= i)
+        g_usleep (100);
+    }
+
+  return NULL;
+}
+
+static gint
+compare_samples (gconstpointer a,
+                 gconstpointer b)
+{
+  const gint64 *sa = a, *sb = b;
+
+  return (*sa > *sb) - (*sa < *sb);
+}
+
+static void
+bench_latency (Backend *backend,
+               guint    n_fds,
+               gdouble  churn_ratio)
+{
+  GSource **sources, *latency_source;
+  guint64 n_dispatched = 0;
+  GThread *producer;
+  guint i, n_churn, next_churn = 0;
+  gint *fds;
+
+  n_churn = get_n_churn (n_fds, churn_ratio);
+
+  fds = open_fds (n_fds);
+  sources = g_new (GSource *, n_fds);
+  for (i = 0; i < n_fds; i++)
+    sources[i] = bench_source_new (backend->context, fds[i], &n_dispatched);
+
+  latency_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  latency_source = bench_source_new (backend->context, latency_fd,
+                                     &n_dispatched);
+  latency_samples = g_new (gint64, n_samples);
+  n_latency_samples = 0;
+
+  producer = g_thread_new ("latency-producer", latency_producer, NULL);
+  while (g_atomic_int_get (&n_latency_samples) < n_samples)
+    {
+      churn_sources (backend, sources, fds, n_fds, n_churn, &next_churn, 0,
+                     &n_dispatched);
+      g_main_context_iteration (backend->context, TRUE);
+    }
+  g_thread_join (producer);
+
+  qsort (latency_samples, n_samples, sizeof (gint64), compare_samples);
+
+  g_print ("{ \"bench\": \"latency\", \"backend\": \"%s\", \"n_fds\": %u, "
+           "\"churn_ratio\": %g, \"samples\": %d, "
+           "\"p50_us\": %" G_GINT64_FORMAT ", "
+           "\"p99_us\": %" G_GINT64_FORMAT ", \"max_us\": %" G_GINT64_FORMAT
+           " }\n",
+           backend->name, n_fds, churn_ratio, n_samples,
+           latency_samples[n_samples / 2],
+           latency_samples[n_samples * 99 / 100],
+           latency_samples[n_samples - 1]);
+
+  g_source_destroy (latency_source);
+  g_source_unref (latency_source);
+  close (latency_fd);
+  latency_fd = -1;
+  g_free (latency_samples);
+
+  for (i = 0; i < n_fds; i++)
+    {
+      g_source_destroy (sources[i]);
+      g_source_unref (sources[i]);
+    }
+  g_free (sources);
+  close_fds (fds, n_fds);
+
+  g_main_context_iteration (backend->context, FALSE);
+}
+
+static guint
+raise_fd_limit (void)
+{
+  struct rlimit limit;
+
+  if (getrlimit (RLIMIT_NOFILE, &limit) < 0)
+    return 1024;
+
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit (RLIMIT_NOFILE, &limit);
+  getrlimit (RLIMIT_NOFILE, &limit);
+
+  return limit.rlim_cur;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  static const guint fd_counts[] = { 1, 10, 100, 1000, 10000 };
+  static const gdouble ready_ratios[] = { 0, 0.01, 0.1, 1 };
+  static const gdouble churn_ratios[] = { 0, 0.01, 0.1 };
+  GOptionContext *option_context;
+  Backend backends[3];
+  GError *error = NULL;
+  guint fd_limit, b, i, j, k;
+
+  option_context = g_option_context_new ("- benchmark g_android_poll()");
+  g_option_context_add_main_entries (option_context, entries, NULL);
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free (option_context);
+
+  fd_limit = raise_fd_limit ();
+  backends_init (&backends[0], &backends[1], &backends[2]);
+
+  for (b = 0; b < G_N_ELEMENTS (backends); b++)
+    {
+      Backend *backend = &backends[b];
+
+      if (only_backend && strcmp (only_backend, backend->name) != 0)
+        continue;
+
+      for (i = 0; i < G_N_ELEMENTS (fd_counts); i++)
+        {
+          guint n_fds = fd_counts[i];
+
+          if (n_fds > (guint) max_fds)
+            break;
+
+          if (n_fds + 64 > fd_limit)
+            {
+              g_printerr ("Skipping %u fds, the fd limit is %u\n",
+                          n_fds, fd_limit);
+              break;
+            }
+
+          for (j = 0; j < G_N_ELEMENTS (ready_ratios); j++)
+            for (k = 0; k < G_N_ELEMENTS (churn_ratios); k++)
+              bench_iterations (backend, n_fds, ready_ratios[j],
+                                churn_ratios[k]);
+
+          for (k = 0; k < G_N_ELEMENTS (churn_ratios); k++)
+            bench_latency (backend, n_fds, churn_ratios[k]);
+        }
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/* the wrappers have to be actual functions */
+#undef _FORTIFY_SOURCE
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "syscall-count.h"
+
+static __thread gboolean counting;
+static __thread guint64 n_syscalls;
+
+void
+syscall_count_begin (void)
+{
+  n_syscalls = 0;
+  counting = TRUE;
+}
+
+guint64
+syscall_count_end (void)
+{
+  counting = FALSE;
+
+  return n_syscalls;
+}
+
+/* Looks the libc function up and counts the call */
+#define REAL(func)                                                      \
+  static __typeof__ (func) *real_##func;                                \
+                                                                        \
+  if (G_UNLIKELY (real_##func == NULL))                                 \
+    real_##func = (__typeof__ (func) *) dlsym (RTLD_NEXT, #func);       \
+  if (counting)                                                         \
+    n_syscalls++
+
+ssize_t
+read (int     fd,
+      void   *buf,
+      size_t  count)
+{
+  REAL (read);
+
+  return real_read (fd, buf, count);
+}
+
+ssize_t
+write (int         fd,
+       const void *buf,
+       size_t      count)
+{
+  REAL (write);
+
+  return real_write (fd, buf, count);
+}
+
+int
+close (int fd)
+{
+  REAL (close);
+
+  return real_close (fd);
+}
+
+int
+fstat (int          fd,
+       struct stat *buf)
+{
+  REAL (fstat);
+
+  return real_fstat (fd, buf);
+}
+
+int
+fcntl (int fd,
+       int cmd,
+       ...)
+{
+  va_list args;
+  void *arg;
+
+  REAL (fcntl);
+
+  va_start (args, cmd);
+  arg = va_arg (args, void *);
+  va_end (args);
+
+  return real_fcntl (fd, cmd, arg);
+}
+
+int
+ioctl (int           fd,
+       unsigned long request,
+       ...)
+{
+  va_list args;
+  void *arg;
+
+  REAL (ioctl);
+
+  va_start (args, request);
+  arg = va_arg (args, void *);
+  va_end (args);
+
+  return real_ioctl (fd, request, arg);
+}
+
+int
+poll (struct pollfd *fds,
+      nfds_t         n_fds,
+      int            timeout)
+{
+  REAL (poll);
+
+  return real_poll (fds, n_fds, timeout);
+}
+
+int
+ppoll (struct pollfd         *fds,
+       nfds_t                 n_fds,
+       const struct timespec *timeout,
+       const sigset_t        *sigmask)
+{
+  REAL (ppoll);
+
+  return real_ppoll (fds, n_fds, timeout, sigmask);
+}
+
+int
+epoll_wait (int                 epfd,
+            struct epoll_event *events,
+            int                 max_events,
+            int                 timeout)
+{
+  REAL (epoll_wait);
+
+  return real_epoll_wait (epfd, events, max_events, timeout);
+}
+
+int
+epoll_ctl (int                 epfd,
+           int                 op,
+           int                 fd,
+           struct epoll_event *event)
+{
+  REAL (epoll_ctl);
+
+  return real_epoll_ctl (epfd, op, fd, event);
+}
+
+/* GLib issues futex() through syscall() */
+long
+syscall (long number,
+         ...)
+{
+  va_list args;
+  long a[6];
+  gint i;
+
+  REAL (syscall);
+
+  va_start (args, number);
+  for (i = 0; i < 6; i++)
+    a[i] = va_arg (args, long);
+  va_end (args);
+
+  return real_syscall (number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
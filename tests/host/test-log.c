@@ -0,0 +1,678 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * Host counterpart of tests/test-log: checks what the log handler installed
+ * by g_android_init() writes to the liblog stand-in.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <android/log.h>
+
+#include <android-host.h>
+#include <glib-android.h>
+#include <glib-android-trace.h>
+
+typedef struct
+{
+  GMutex lock;
+  GPtrArray *messages;
+
+  /* while set, the writes block until it is cleared */
+  gboolean stalled;
+  gboolean writing;
+  GCond cond;
+} TestData;
+
+static TestData data;
+
+static void
+on_log_write (int         prio,
+              const char *tag,
+              const char *text,
+              void       *user_data)
+{
+  g_mutex_lock (&data.lock);
+
+  data.writing = TRUE;
+  g_cond_broadcast (&data.cond);
+  while (data.stalled)
+    g_cond_wait (&data.cond, &data.lock);
+  data.writing = FALSE;
+
+  g_ptr_array_add (data.messages,
+                   g_strdup_printf ("%d/%s: %s", prio, tag ? tag : "", text));
+
+  g_mutex_unlock (&data.lock);
+}
+
+static void
+reset_messages (void)
+{
+  g_mutex_lock (&data.lock);
+  g_ptr_array_set_size (data.messages, 0);
+  g_mutex_unlock (&data.lock);
+}
+
+static const gchar *
+get_message (guint i)
+{
+  g_assert_cmpuint (i, <, data.messages->len);
+
+  return g_ptr_array_index (data.messages, i);
+}
+
+static void
+test_sync (void)
+{
+  reset_messages ();
+
+  g_message ("message");
+  g_debug ("debug");
+  g_log ("Other", G_LOG_LEVEL_INFO, "info");
+
+  g_assert_cmpuint (data.messages->len, ==, 3);
+  g_assert_cmpstr (get_message (0), ==, "4/TestLog: message");
+  g_assert_cmpstr (get_message (1), ==, "3/TestLog: debug");
+  g_assert_cmpstr (get_message (2), ==, "4/Other: info");
+}
+
+static gint
+count_evaluations (gint *counter)
+{
+  return (*counter)++;
+}
+
+/* Messages below the threshold of their domain are dropped */
+static void
+test_thresholds (void)
+{
+  gint n_evaluations = 0;
+
+  reset_messages ();
+
+  g_android_log_set_threshold ("Other", G_LOG_LEVEL_INFO);
+  g_android_log_set_threshold ("*", G_LOG_LEVEL_MESSAGE);
+
+  g_assert (g_android_log_is_enabled ("Other", G_LOG_LEVEL_INFO));
+  g_assert (!g_android_log_is_enabled ("Other", G_LOG_LEVEL_DEBUG));
+  g_assert (g_android_log_is_enabled ("TestLog", G_LOG_LEVEL_MESSAGE));
+  g_assert (!g_android_log_is_enabled ("TestLog", G_LOG_LEVEL_INFO));
+  g_assert (!g_android_log_is_enabled (NULL, G_LOG_LEVEL_DEBUG));
+
+  /* from G_ANDROID_LOG_LEVELS */
+  g_assert (g_android_log_is_enabled ("Env", G_LOG_LEVEL_WARNING));
+  g_assert (!g_android_log_is_enabled ("Env", G_LOG_LEVEL_MESSAGE));
+  g_assert (!g_android_log_is_enabled ("Silent", G_LOG_LEVEL_CRITICAL));
+
+  g_log ("Other", G_LOG_LEVEL_DEBUG, "dropped");
+  g_log ("Other", G_LOG_LEVEL_INFO, "info");
+  g_info ("dropped");
+  g_message ("message");
+  g_android_debug ("%d", count_evaluations (&n_evaluations));
+
+  g_assert_cmpint (n_evaluations, ==, 0);
+  g_assert_cmpuint (data.messages->len, ==, 2);
+  g_assert_cmpstr (get_message (0), ==, "4/Other: info");
+  g_assert_cmpstr (get_message (1), ==, "4/TestLog: message");
+
+  g_android_log_set_threshold ("*", G_LOG_LEVEL_DEBUG);
+  g_android_debug ("%d", count_evaluations (&n_evaluations));
+  g_assert_cmpint (n_evaluations, ==, 1);
+  g_assert_cmpstr (get_message (2), ==, "3/TestLog: 0");
+
+  g_android_log_set_threshold ("Other", G_LOG_LEVEL_DEBUG);
+}
+
+/* Identical consecutive messages are collapsed */
+static void
+test_repeats (void)
+{
+  GAndroidLogStats before, after;
+  gint i;
+
+  reset_messages ();
+  g_android_log_get_stats (&before);
+
+  g_android_log_set_collapse_repeats (TRUE);
+  for (i = 0; i < 5; i++)
+    g_message ("same");
+  g_log ("Other", G_LOG_LEVEL_MESSAGE, "same");
+  g_message ("other");
+  g_message ("other");
+  g_android_log_set_collapse_repeats (FALSE);
+  g_message ("other");
+
+  g_android_log_get_stats (&after);
+  g_assert_cmpuint (after.n_repeated - before.n_repeated, ==, 5);
+
+  g_assert_cmpuint (data.messages->len, ==, 6);
+  g_assert_cmpstr (get_message (0), ==, "4/TestLog: same");
+  g_assert_cmpstr (get_message (1), ==,
+                   "4/TestLog: last message repeated 4 times");
+  g_assert_cmpstr (get_message (2), ==, "4/Other: same");
+  g_assert_cmpstr (get_message (3), ==, "4/TestLog: other");
+  g_assert_cmpstr (get_message (4), ==,
+                   "4/TestLog: last message repeated 1 times");
+  g_assert_cmpstr (get_message (5), ==, "4/TestLog: other");
+}
+
+/* Messages over the rate limit of their domain are dropped */
+static void
+test_rate_limit (void)
+{
+  GAndroidLogStats before, after;
+  gint i;
+
+  reset_messages ();
+  g_android_log_get_stats (&before);
+
+  g_android_log_set_rate_limit ("Other", 1, 3);
+  for (i = 0; i < 10; i++)
+    {
+      g_log ("Other", G_LOG_LEVEL_MESSAGE, "%d", i);
+      g_message ("%d", i);
+    }
+  g_android_log_set_rate_limit ("Other", 0, 0);
+  g_log ("Other", G_LOG_LEVEL_MESSAGE, "unlimited");
+
+  g_android_log_get_stats (&after);
+  g_assert_cmpuint (after.n_rate_limited - before.n_rate_limited, ==, 7);
+
+  g_assert_cmpuint (data.messages->len, ==, 14);
+  g_assert_cmpstr (get_message (0), ==, "4/Other: 0");
+  g_assert_cmpstr (get_message (4), ==, "4/Other: 2");
+  g_assert_cmpstr (get_message (5), ==, "4/TestLog: 2");
+  g_assert_cmpstr (get_message (6), ==, "4/TestLog: 3");
+  g_assert_cmpstr (get_message (13), ==, "4/Other: unlimited");
+
+  /* a message dropped by its rate limit isn't what the next ones repeat */
+  reset_messages ();
+  g_android_log_set_collapse_repeats (TRUE);
+  g_android_log_set_rate_limit ("Other", 1, 1);
+  g_log ("Other", G_LOG_LEVEL_MESSAGE, "written");
+  g_log ("Other", G_LOG_LEVEL_MESSAGE, "dropped");
+  g_log ("Other", G_LOG_LEVEL_MESSAGE, "dropped");
+  g_android_log_set_rate_limit ("Other", 0, 0);
+  g_log ("Other", G_LOG_LEVEL_MESSAGE, "unlimited");
+  g_android_log_set_collapse_repeats (FALSE);
+
+  g_assert_cmpuint (data.messages->len, ==, 2);
+  g_assert_cmpstr (get_message (0), ==, "4/Other: written");
+  g_assert_cmpstr (get_message (1), ==, "4/Other: unlimited");
+}
+
+#define N_LOGGERS 4
+#define N_MESSAGES 200
+
+static gpointer
+logger_thread (gpointer user_data)
+{
+  gint id = GPOINTER_TO_INT (user_data);
+  gint i;
+
+  for (i = 0; i < N_MESSAGES; i++)
+    g_message ("%d %d", id, i);
+
+  return NULL;
+}
+
+/* Checks the messages of each logger are in order, returns their number */
+static guint
+check_loggers_messages (void)
+{
+  gint last[N_LOGGERS], id, i;
+  guint j;
+
+  for (id = 0; id < N_LOGGERS; id++)
+    last[id] = -1;
+
+  for (j = 0; j < data.messages->len; j++)
+    {
+      g_assert (sscanf (get_message (j), "4/TestLog: %d %d", &id, &i) == 2);
+      g_assert_cmpint (id, <, N_LOGGERS);
+      g_assert_cmpint (i, >, last[id]);
+      last[id] = i;
+    }
+
+  return data.messages->len;
+}
+
+static void
+run_loggers (void)
+{
+  GThread *threads[N_LOGGERS];
+  gint id;
+
+  for (id = 0; id < N_LOGGERS; id++)
+    threads[id] = g_thread_new ("logger", logger_thread, GINT_TO_POINTER (id));
+  for (id = 0; id < N_LOGGERS; id++)
+    g_thread_join (threads[id]);
+
+  g_android_log_flush ();
+}
+
+/* With the block policy, no message is lost */
+static void
+test_async_block (void)
+{
+  GAndroidLogStats before, after;
+
+  reset_messages ();
+  g_android_log_get_stats (&before);
+
+  g_assert (g_android_log_set_async (TRUE, 8, G_ANDROID_LOG_OVERFLOW_BLOCK));
+  run_loggers ();
+  g_assert (g_android_log_set_async (FALSE, 0, G_ANDROID_LOG_OVERFLOW_BLOCK));
+
+  g_android_log_get_stats (&after);
+  g_assert_cmpuint (after.n_dropped, ==, before.n_dropped);
+  g_assert_cmpuint (check_loggers_messages (), ==, N_LOGGERS * N_MESSAGES);
+}
+
+/* The messages that don't get dropped are written in order */
+static void
+test_async_drop_oldest (void)
+{
+  GAndroidLogStats before, after;
+
+  reset_messages ();
+  g_android_log_get_stats (&before);
+
+  g_assert (g_android_log_set_async (TRUE, 8,
+                                     G_ANDROID_LOG_OVERFLOW_DROP_OLDEST));
+  run_loggers ();
+  g_assert (g_android_log_set_async (FALSE, 0,
+                                     G_ANDROID_LOG_OVERFLOW_DROP_OLDEST));
+
+  g_android_log_get_stats (&after);
+  g_assert_cmpuint (check_loggers_messages () + after.n_dropped -
+                    before.n_dropped, ==, N_LOGGERS * N_MESSAGES);
+}
+
+/* A full ring drops its oldest messages, fatal and long messages are written
+ * once the ring has been flushed */
+static void
+test_async_overflow (void)
+{
+  GAndroidLogStats before, after;
+  gchar *long_message;
+  gint i;
+
+  reset_messages ();
+  g_android_log_get_stats (&before);
+  g_assert (g_android_log_set_async (TRUE, 8,
+                                     G_ANDROID_LOG_OVERFLOW_DROP_OLDEST));
+
+  /* stall the writer thread on the first message */
+  g_mutex_lock (&data.lock);
+  data.stalled = TRUE;
+  g_mutex_unlock (&data.lock);
+
+  g_message ("first");
+
+  g_mutex_lock (&data.lock);
+  while (!data.writing)
+    g_cond_wait (&data.cond, &data.lock);
+  g_mutex_unlock (&data.lock);
+
+  for (i = 0; i < 12; i++)
+    g_message ("%d", i);
+
+  g_android_log_get_stats (&after);
+  g_assert_cmpuint (after.n_dropped - before.n_dropped, ==, 4);
+
+  g_mutex_lock (&data.lock);
+  data.stalled = FALSE;
+  g_cond_broadcast (&data.cond);
+  g_mutex_unlock (&data.lock);
+
+  long_message = g_strnfill (1024, 'x');
+  g_message ("%s", long_message);
+
+  g_assert (g_android_log_set_async (FALSE, 0,
+                                     G_ANDROID_LOG_OVERFLOW_DROP_OLDEST));
+
+  g_assert_cmpuint (data.messages->len, ==, 10);
+  g_assert_cmpstr (get_message (0), ==, "4/TestLog: first");
+  g_assert_cmpstr (get_message (1), ==, "4/TestLog: 4");
+  g_assert_cmpstr (get_message (8), ==, "4/TestLog: 11");
+  g_assert (g_str_has_suffix (get_message (9), long_message));
+
+  g_free (long_message);
+}
+
+#if GLIB_CHECK_VERSION (2, 50, 0)
+static guint64
+decode_varint (const guint8 **p)
+{
+  guint64 value = 0;
+  guint shift = 0;
+
+  while (**p & 0x80)
+    {
+      value |= (guint64) (*(*p)++ & 0x7f) << shift;
+      shift += 7;
+    }
+  value |= (guint64) *(*p)++ << shift;
+
+  return value;
+}
+
+static void
+on_log_fields (const guint8 *buffer,
+               gsize         size,
+               gpointer      user_data)
+{
+  GHashTable *fields = user_data;
+  const guint8 *p, *end;
+  gsize key_len, value_len;
+  gchar *key;
+
+  p = buffer;
+  end = buffer + size;
+
+  g_assert_cmpuint (decode_varint (&p), >, 0);
+  g_assert_cmpuint (decode_varint (&p), ==, G_LOG_LEVEL_MESSAGE);
+
+  while (p < end)
+    {
+      key_len = decode_varint (&p);
+      key = g_strndup ((const gchar *) p, key_len);
+      p += key_len;
+      value_len = decode_varint (&p);
+      g_hash_table_insert (fields, key,
+                           g_strndup ((const gchar *) p, value_len));
+      p += value_len;
+    }
+
+  g_assert (p == end);
+}
+
+/* The fields of g_log_structured() end up in the text and in the sink */
+static void
+test_structured (void)
+{
+  static const GLogField error_fields[] =
+    {
+      { "GLIB_DOMAIN", "Other", -1 },
+      { "MESSAGE", "failed", -1 },
+      { "CODE_FILE", "x.c", -1 },
+      { "CODE_LINE", "20", -1 },
+      { "CODE_FUNC", "f", -1 }
+    };
+  GHashTable *fields;
+  gint i;
+
+  reset_messages ();
+
+  fields = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  g_android_log_set_field_sink (on_log_fields, fields);
+
+  g_log_structured ("Other", G_LOG_LEVEL_MESSAGE,
+                    "CODE_FILE", "x.c",
+                    "CODE_LINE", "12",
+                    "CODE_FUNC", "f",
+                    "USER_FIELD", "v",
+                    "MESSAGE", "hello %d", 1);
+  g_log_structured ("Silent", G_LOG_LEVEL_MESSAGE, "MESSAGE", "dropped");
+
+  g_android_log_set_field_sink (NULL, NULL);
+
+  g_assert_cmpuint (data.messages->len, ==, 1);
+  g_assert_cmpstr (get_message (0), ==,
+                   "4/Other: hello 1 [x.c:12 f()] USER_FIELD=v");
+
+  g_assert_cmpstr (g_hash_table_lookup (fields, "GLIB_DOMAIN"), ==, "Other");
+  g_assert_cmpstr (g_hash_table_lookup (fields, "MESSAGE"), ==, "hello 1");
+  g_assert_cmpstr (g_hash_table_lookup (fields, "CODE_LINE"), ==, "12");
+  g_assert_cmpstr (g_hash_table_lookup (fields, "USER_FIELD"), ==, "v");
+
+  g_hash_table_unref (fields);
+
+  /* errors are fatal: written right away, never collapsed or rate limited */
+  reset_messages ();
+  g_android_log_set_collapse_repeats (TRUE);
+  g_android_log_set_rate_limit ("Other", 1, 1);
+  g_assert (g_android_log_set_async (TRUE, 8, G_ANDROID_LOG_OVERFLOW_BLOCK));
+
+  for (i = 0; i < 3; i++)
+    g_android_log_writer (G_LOG_LEVEL_ERROR, error_fields,
+                          G_N_ELEMENTS (error_fields), NULL);
+  g_assert_cmpuint (data.messages->len, ==, 3);
+
+  g_assert (g_android_log_set_async (FALSE, 0, G_ANDROID_LOG_OVERFLOW_BLOCK));
+  g_android_log_set_rate_limit ("Other", 0, 0);
+  g_android_log_set_collapse_repeats (FALSE);
+
+  for (i = 0; i < 3; i++)
+    g_assert_cmpstr (get_message (i), ==, "7/Other: failed [x.c:20 f()]");
+}
+#endif
+
+static const GAndroidTraceRecord *
+get_trace_record (const GAndroidTraceHeader *header,
+                  guint32                    pos)
+{
+  const gchar *slots = (const gchar *) header + G_ANDROID_TRACE_DATA_OFFSET;
+
+  return (gconstpointer) (slots + (pos % header->n_slots) *
+                                  G_ANDROID_TRACE_SLOT_SIZE);
+}
+
+/* The messages go to the trace file instead of the Android log */
+static void
+test_trace (void)
+{
+  const GAndroidTraceHeader *header;
+  const GAndroidTraceRecord *record;
+  gchar *filename, *contents, *long_message;
+  GError *error = NULL;
+  gint64 base_monotonic_time;
+  gsize size;
+  gint fd, i;
+
+  reset_messages ();
+
+  fd = g_file_open_tmp ("test-log-XXXXXX.trace", &filename, &error);
+  g_assert_no_error (error);
+  close (fd);
+
+  g_assert (g_android_log_set_trace_file (filename, 16, &error));
+  g_assert_no_error (error);
+
+  for (i = 0; i < 20; i++)
+    g_message ("traced %d", i);
+  long_message = g_strnfill (300, 'x');
+  g_log ("Other", G_LOG_LEVEL_INFO, "%s", long_message);
+
+  g_assert (g_android_log_set_trace_file (NULL, 0, NULL));
+  g_message ("not traced");
+
+  g_assert_cmpuint (data.messages->len, ==, 1);
+
+  g_assert (g_file_get_contents (filename, &contents, &size, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (size, ==, G_ANDROID_TRACE_DATA_OFFSET +
+                              16 * G_ANDROID_TRACE_SLOT_SIZE);
+
+  header = (gconstpointer) contents;
+  g_assert (memcmp (header->magic, G_ANDROID_TRACE_MAGIC, 8) == 0);
+  g_assert_cmpuint (header->write_pos, ==, 23);
+  g_assert_cmpuint (header->n_domains, ==, 2);
+  g_assert_cmpstr (header->domains[0], ==, "TestLog");
+  g_assert_cmpstr (header->domains[1], ==, "Other");
+
+  record = get_trace_record (header, 19);
+  g_assert_cmpuint (record->sequence, ==, 20);
+  g_assert_cmpuint (record->n_slots, ==, 1);
+  g_assert_cmpuint (record->priority, ==, ANDROID_LOG_INFO);
+  g_assert_cmpuint (record->domain, ==, 1);
+  g_assert_cmpuint (record->length, ==, strlen ("traced 19"));
+  g_assert (memcmp (record->message, "traced 19", record->length) == 0);
+
+  record = get_trace_record (header, 20);
+  g_assert_cmpuint (record->sequence, ==, 21);
+  g_assert_cmpuint (record->n_slots, ==, 3);
+  g_assert_cmpuint (record->domain, ==, 2);
+  g_assert_cmpuint (record->length, ==, 300);
+  g_assert_cmpuint (get_trace_record (header, 22)->sequence, ==, 23);
+
+  /* overwritten by the long message */
+  g_assert_cmpuint (get_trace_record (header, 4)->sequence, !=, 5);
+
+  unlink (filename);
+  g_free (contents);
+
+  /* the summaries of repeats are written with a copy of the domain made on
+   * the stack, each has to get the id of its own domain */
+  g_assert (g_android_log_set_trace_file (filename, 16, &error));
+  g_assert_no_error (error);
+  g_android_log_set_collapse_repeats (TRUE);
+
+  for (i = 0; i < 3; i++)
+    g_log ("Other", G_LOG_LEVEL_INFO, "again");
+  for (i = 0; i < 3; i++)
+    g_log ("Third", G_LOG_LEVEL_INFO, "again");
+  g_log ("Other", G_LOG_LEVEL_INFO, "done");
+
+  g_android_log_set_collapse_repeats (FALSE);
+  g_assert (g_android_log_set_trace_file (NULL, 0, NULL));
+
+  g_assert (g_file_get_contents (filename, &contents, &size, &error));
+  g_assert_no_error (error);
+
+  header = (gconstpointer) contents;
+  g_assert_cmpuint (header->write_pos, ==, 5);
+  g_assert_cmpuint (header->n_domains, ==, 2);
+  g_assert_cmpstr (header->domains[0], ==, "Other");
+  g_assert_cmpstr (header->domains[1], ==, "Third");
+
+  for (i = 0; i < 5; i++)
+    {
+      static const struct
+      {
+        guint8 domain;
+        const gchar *message;
+      } expected[] =
+        {
+          { 1, "again" },
+          { 1, "last message repeated 2 times" },
+          { 2, "again" },
+          { 2, "last message repeated 2 times" },
+          { 1, "done" }
+        };
+
+      record = get_trace_record (header, i);
+      g_assert_cmpuint (record->domain, ==, expected[i].domain);
+      g_assert_cmpuint (record->length, ==, strlen (expected[i].message));
+      g_assert (memcmp (record->message, expected[i].message,
+                        record->length) == 0);
+    }
+
+  /* appending keeps the base times the records are decoded with */
+  base_monotonic_time = header->base_monotonic_time;
+  g_free (contents);
+
+  g_assert (g_android_log_set_trace_file (filename, 16, &error));
+  g_assert_no_error (error);
+  g_message ("appended");
+  g_assert (g_android_log_set_trace_file (NULL, 0, NULL));
+
+  g_assert (g_file_get_contents (filename, &contents, &size, &error));
+  g_assert_no_error (error);
+
+  header = (gconstpointer) contents;
+  g_assert_cmpuint (header->write_pos, ==, 6);
+  g_assert_cmpint (header->base_monotonic_time, ==, base_monotonic_time);
+  g_assert_cmpint (get_trace_record (header, 5)->time, >=,
+                   get_trace_record (header, 4)->time);
+
+  unlink (filename);
+  g_free (contents);
+
+  /* the ring holds a record of the longest message at least */
+  g_assert (g_android_log_set_trace_file (filename, 1, &error));
+  g_assert_no_error (error);
+  g_assert (g_android_log_set_trace_file (NULL, 0, NULL));
+
+  g_assert (g_file_get_contents (filename, &contents, &size, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (size, ==, G_ANDROID_TRACE_DATA_OFFSET +
+                              G_ANDROID_TRACE_MAX_SLOTS *
+                              G_ANDROID_TRACE_SLOT_SIZE);
+
+  unlink (filename);
+  g_free (contents);
+  g_free (long_message);
+  g_free (filename);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_mutex_init (&data.lock);
+  g_cond_init (&data.cond);
+  data.messages = g_ptr_array_new_with_free_func (g_free);
+  android_host_log_set_func (on_log_write, NULL);
+
+  g_setenv ("G_ANDROID_LOG_LEVELS", "Env:W,Silent:S", TRUE);
+  g_android_init ();
+
+  g_test_add_func ("/log/sync", test_sync);
+  g_test_add_func ("/log/thresholds", test_thresholds);
+  g_test_add_func ("/log/repeats", test_repeats);
+  g_test_add_func ("/log/rate-limit", test_rate_limit);
+  g_test_add_func ("/log/trace", test_trace);
+#if GLIB_CHECK_VERSION (2, 50, 0)
+  g_test_add_func ("/log/structured", test_structured);
+#endif
+  g_test_add_func ("/log/async-block", test_async_block);
+  g_test_add_func ("/log/async-drop-oldest", test_async_drop_oldest);
+  g_test_add_func ("/log/async-overflow", test_async_overflow);
+
+  return g_test_run ();
+}
@@ -0,0 +1,1640 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * Host counterpart of tests/test-mainloop: runs GLib's default main context
+ * with g_android_poll() on top of the ALooper stand-in and a fake android_app.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include <android-host.h>
+#include <glib-android.h>
+
+#include "syscall-count.h"
+
+typedef struct
+{
+  struct android_app *app;
+
+  gint n_cmds;
+  gint32 last_cmd;
+
+  gint n_input_events;
+  gfloat last_x, last_y;
+
+  gint n_dispatched;
+} TestData;
+
+static TestData data;
+
+static void
+test_handle_cmd (struct android_app *app,
+                 int32_t             cmd)
+{
+  TestData *test_data = app->userData;
+
+  test_data->n_cmds++;
+  test_data->last_cmd = cmd;
+
+  g_main_context_wakeup (NULL);
+}
+
+static int32_t
+test_handle_input (struct android_app *app,
+                   AInputEvent        *event)
+{
+  TestData *test_data = app->userData;
+
+  if (AInputEvent_getType (event) != AINPUT_EVENT_TYPE_MOTION)
+    return 0;
+
+  test_data->n_input_events++;
+  test_data->last_x = AMotionEvent_getX (event, 0);
+  test_data->last_y = AMotionEvent_getY (event, 0);
+
+  g_main_context_wakeup (NULL);
+
+  return 1;
+}
+
+static gboolean
+on_timeout_expired (gpointer user_data)
+{
+  g_error ("Test timed out");
+
+  return FALSE;
+}
+
+/* Iterate the default context until *counter reaches value */
+static void
+iterate_until (gint *counter,
+               gint  value)
+{
+  guint timeout_id;
+
+  timeout_id = g_timeout_add_seconds (5, on_timeout_expired, NULL);
+
+  while (*counter < value)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_source_remove (timeout_id);
+}
+
+static gboolean
+on_fd_ready (GIOChannel   *channel,
+             GIOCondition  condition,
+             gpointer      user_data)
+{
+  gchar byte;
+
+  g_assert (condition & G_IO_IN);
+
+  g_assert_cmpint (read (g_io_channel_unix_get_fd (channel), &byte, 1), ==, 1);
+  data.n_dispatched++;
+
+  return TRUE;
+}
+
+static void
+test_fd (void)
+{
+  GIOChannel *channel;
+  guint watch_id;
+  gint fds[2];
+
+  g_assert_cmpint (pipe (fds), ==, 0);
+
+  channel = g_io_channel_unix_new (fds[0]);
+  watch_id = g_io_add_watch (channel, G_IO_IN, on_fd_ready, NULL);
+
+  data.n_dispatched = 0;
+  g_assert_cmpint (write (fds[1], "x", 1), ==, 1);
+  iterate_until (&data.n_dispatched, 1);
+
+  g_assert_cmpint (write (fds[1], "x", 1), ==, 1);
+  iterate_until (&data.n_dispatched, 2);
+
+  g_source_remove (watch_id);
+  g_io_channel_unref (channel);
+  close (fds[0]);
+  close (fds[1]);
+}
+
+#define N_FDS 64
+
+/* All the ready fds are dispatched in a single iteration */
+static void
+test_many_fds (void)
+{
+  GIOChannel *channels[N_FDS];
+  guint watch_ids[N_FDS];
+  gint fds[N_FDS][2];
+  gint i;
+
+  for (i = 0; i < N_FDS; i++)
+    {
+      g_assert_cmpint (pipe (fds[i]), ==, 0);
+      channels[i] = g_io_channel_unix_new (fds[i][0]);
+      watch_ids[i] = g_io_add_watch (channels[i], G_IO_IN, on_fd_ready, NULL);
+    }
+
+  /* Let the fds be registered with the looper */
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  data.n_dispatched = 0;
+  for (i = 0; i < N_FDS; i++)
+    g_assert_cmpint (write (fds[i][1], "x", 1), ==, 1);
+
+  g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpint (data.n_dispatched, ==, N_FDS);
+
+  for (i = 0; i < N_FDS; i++)
+    {
+      g_source_remove (watch_ids[i]);
+      g_io_channel_unref (channels[i]);
+      close (fds[i][0]);
+      close (fds[i][1]);
+    }
+}
+
+static guint64
+get_n_epoll_ctl (void)
+{
+  AndroidHostLooperStats stats;
+
+  android_host_looper_get_stats (ALooper_forThread (), &stats);
+
+  return stats.n_epoll_ctl;
+}
+
+/* Only the fds joining, leaving or reused are registered again */
+static void
+test_fd_registry (void)
+{
+  GIOChannel *channels[N_FDS], *channel;
+  guint watch_ids[N_FDS], watch_id;
+  gint fds[N_FDS][2], new_fds[2];
+  guint64 n_epoll_ctl;
+  gint i;
+
+  for (i = 0; i < N_FDS; i++)
+    {
+      g_assert_cmpint (pipe (fds[i]), ==, 0);
+      channels[i] = g_io_channel_unix_new (fds[i][0]);
+      watch_ids[i] = g_io_add_watch (channels[i], G_IO_IN, on_fd_ready, NULL);
+    }
+
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  /* the poll reporting the change of poll records has the next one check
+   * the fds for reuse */
+  g_main_context_iteration (NULL, FALSE);
+
+  /* nothing changed, no syscall per fd: the poll, and the drain of the
+   * responses left queued by the last poll that reported an fd */
+  n_epoll_ctl = get_n_epoll_ctl ();
+  syscall_count_begin ();
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_cmpuint (syscall_count_end (), <=, 2);
+  g_assert_cmpuint (get_n_epoll_ctl () - n_epoll_ctl, ==, 0);
+
+  /* GLib blocks the source it dispatches, changing its poll records, but no
+   * source was attached: the fds aren't checked */
+  data.n_dispatched = 0;
+  g_assert_cmpint (write (fds[1][1], "x", 1), ==, 1);
+  while (data.n_dispatched == 0)
+    g_main_context_iteration (NULL, FALSE);
+  syscall_count_begin ();
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_cmpuint (syscall_count_end (), <, N_FDS);
+
+  /* one source joins, then leaves */
+  g_assert_cmpint (pipe (new_fds), ==, 0);
+  channel = g_io_channel_unix_new (new_fds[0]);
+  watch_id = g_io_add_watch (channel, G_IO_IN, on_fd_ready, NULL);
+  n_epoll_ctl = get_n_epoll_ctl ();
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_cmpuint (get_n_epoll_ctl () - n_epoll_ctl, ==, 1);
+
+  g_source_remove (watch_id);
+  g_io_channel_unref (channel);
+  n_epoll_ctl = get_n_epoll_ctl ();
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_cmpuint (get_n_epoll_ctl () - n_epoll_ctl, ==, 1);
+
+  /* the first fd is closed and its number reused by another pipe before the
+   * next poll, the looper has to be told about the new file */
+  g_source_remove (watch_ids[0]);
+  g_io_channel_unref (channels[0]);
+  g_assert_cmpint (dup2 (new_fds[0], fds[0][0]), ==, fds[0][0]);
+  close (new_fds[0]);
+  close (fds[0][1]);
+  fds[0][1] = new_fds[1];
+  channels[0] = g_io_channel_unix_new (fds[0][0]);
+  watch_ids[0] = g_io_add_watch (channels[0], G_IO_IN, on_fd_ready, NULL);
+
+  n_epoll_ctl = get_n_epoll_ctl ();
+  data.n_dispatched = 0;
+  g_assert_cmpint (write (fds[0][1], "x", 1), ==, 1);
+  iterate_until (&data.n_dispatched, 1);
+  g_assert_cmpuint (get_n_epoll_ctl () - n_epoll_ctl, <=, 2);
+
+  for (i = 0; i < N_FDS; i++)
+    {
+      g_source_remove (watch_ids[i]);
+      g_io_channel_unref (channels[i]);
+      close (fds[i][0]);
+      close (fds[i][1]);
+    }
+}
+
+typedef struct
+{
+  gint fds[2];
+  gint n_dispatched;
+  gboolean is_attached;
+} WorkerData;
+
+static gboolean
+on_worker_fd_ready (GIOChannel   *channel,
+                    GIOCondition  condition,
+                    gpointer      user_data)
+{
+  WorkerData *worker = user_data;
+  gchar byte;
+
+  g_assert_cmpint (read (g_io_channel_unix_get_fd (channel), &byte, 1), ==, 1);
+  g_atomic_int_inc (&worker->n_dispatched);
+
+  return TRUE;
+}
+
+static gpointer
+worker_thread (gpointer user_data)
+{
+  WorkerData *worker = user_data;
+  GMainContext *context;
+  GIOChannel *channel;
+  GSource *source;
+
+  context = g_main_context_new ();
+  worker->is_attached = g_android_attach_context (context);
+  g_assert (ALooper_forThread () != NULL);
+
+  channel = g_io_channel_unix_new (worker->fds[0]);
+  source = g_io_create_watch (channel, G_IO_IN);
+  g_source_set_callback (source, (GSourceFunc) on_worker_fd_ready, worker,
+                         NULL);
+  g_source_attach (source, context);
+
+  while (g_atomic_int_get (&worker->n_dispatched) < 2)
+    g_main_context_iteration (context, TRUE);
+
+  g_source_destroy (source);
+  g_source_unref (source);
+  g_io_channel_unref (channel);
+  g_main_context_unref (context);
+
+  return NULL;
+}
+
+/* A worker thread can run its own context on top of its own looper */
+static void
+test_worker_context (void)
+{
+  WorkerData worker = { { -1, -1 }, 0, FALSE };
+  GThread *thread;
+
+  g_assert_cmpint (pipe (worker.fds), ==, 0);
+
+  thread = g_thread_new ("worker", worker_thread, &worker);
+
+  g_assert_cmpint (write (worker.fds[1], "x", 1), ==, 1);
+  while (g_atomic_int_get (&worker.n_dispatched) < 1)
+    g_usleep (1000);
+  g_assert_cmpint (write (worker.fds[1], "x", 1), ==, 1);
+
+  g_thread_join (thread);
+  g_assert (worker.is_attached);
+  g_assert_cmpint (worker.n_dispatched, ==, 2);
+
+  close (worker.fds[0]);
+  close (worker.fds[1]);
+}
+
+/* A thread alternating between two contexts, as with a nested iteration of a
+ * private context, doesn't register their fds again at each switch */
+static void
+test_nested_context (void)
+{
+  GMainContext *context;
+  GIOChannel *channels[N_FDS], *channel;
+  GSource *source, *shared_source;
+  guint watch_ids[N_FDS];
+  gint fds[N_FDS][2], inner_fds[2];
+  guint64 n_epoll_ctl;
+  gint i;
+
+  for (i = 0; i < N_FDS; i++)
+    {
+      g_assert_cmpint (pipe (fds[i]), ==, 0);
+      channels[i] = g_io_channel_unix_new (fds[i][0]);
+      watch_ids[i] = g_io_add_watch (channels[i], G_IO_IN, on_fd_ready, NULL);
+    }
+
+  context = g_main_context_new ();
+  g_assert (g_android_attach_context (context));
+  g_assert_cmpint (pipe (inner_fds), ==, 0);
+  channel = g_io_channel_unix_new (inner_fds[0]);
+  source = g_io_create_watch (channel, G_IO_IN);
+  g_source_set_callback (source, (GSourceFunc) on_fd_ready, NULL, NULL);
+  g_source_attach (source, context);
+
+  /* the fds reused since the previous test are only found by the poll
+   * following the one reporting the change of poll records */
+  for (i = 0; i < 2; i++)
+    {
+      g_main_context_iteration (NULL, FALSE);
+      g_main_context_iteration (context, FALSE);
+    }
+
+  n_epoll_ctl = get_n_epoll_ctl ();
+  for (i = 0; i < 10; i++)
+    {
+      g_main_context_iteration (NULL, FALSE);
+      g_main_context_iteration (context, FALSE);
+    }
+  g_assert_cmpuint (get_n_epoll_ctl () - n_epoll_ctl, ==, 0);
+
+  /* an fd of the default context doesn't wake the other one up and is
+   * dispatched by its own context */
+  data.n_dispatched = 0;
+  g_assert_cmpint (write (fds[0][1], "x", 1), ==, 1);
+  g_assert (!g_main_context_iteration (context, FALSE));
+  g_assert (!g_main_context_iteration (context, FALSE));
+  g_assert_cmpint (data.n_dispatched, ==, 0);
+  iterate_until (&data.n_dispatched, 1);
+
+  g_assert_cmpint (write (inner_fds[1], "x", 1), ==, 1);
+  g_main_context_iteration (context, TRUE);
+  g_assert_cmpint (data.n_dispatched, ==, 2);
+
+  /* the other context takes an fd of the default context over, then lets it
+   * go, the default context still gets it */
+  shared_source = g_io_create_watch (channels[1], G_IO_IN);
+  g_source_set_callback (shared_source, (GSourceFunc) on_fd_ready, NULL,
+                         NULL);
+  g_source_attach (shared_source, context);
+  g_main_context_iteration (context, FALSE);
+  g_source_destroy (shared_source);
+  g_source_unref (shared_source);
+  g_main_context_iteration (context, FALSE);
+
+  g_assert_cmpint (write (fds[1][1], "x", 1), ==, 1);
+  iterate_until (&data.n_dispatched, 3);
+
+  g_source_destroy (source);
+  g_source_unref (source);
+  g_io_channel_unref (channel);
+  close (inner_fds[0]);
+  close (inner_fds[1]);
+  g_main_context_unref (context);
+
+  for (i = 0; i < N_FDS; i++)
+    {
+      g_source_remove (watch_ids[i]);
+      g_io_channel_unref (channels[i]);
+      close (fds[i][0]);
+      close (fds[i][1]);
+    }
+}
+
+/* Same with the fds registered with looper callbacks */
+static void
+test_many_fds_callbacks (void)
+{
+  GMainContext *context;
+  GIOChannel *channels[N_FDS];
+  GSource *sources[N_FDS];
+  gint fds[N_FDS][2];
+  gint i;
+
+  context = g_main_context_new ();
+  g_assert (g_android_attach_context_with_backend (context,
+                                                   G_ANDROID_POLL_BACKEND_CALLBACK));
+
+  for (i = 0; i < N_FDS; i++)
+    {
+      g_assert_cmpint (pipe (fds[i]), ==, 0);
+      channels[i] = g_io_channel_unix_new (fds[i][0]);
+      sources[i] = g_io_create_watch (channels[i], G_IO_IN);
+      g_source_set_callback (sources[i], (GSourceFunc) on_fd_ready, NULL,
+                             NULL);
+      g_source_attach (sources[i], context);
+    }
+
+  while (g_main_context_iteration (context, FALSE))
+    ;
+
+  data.n_dispatched = 0;
+  for (i = 0; i < N_FDS; i++)
+    g_assert_cmpint (write (fds[i][1], "x", 1), ==, 1);
+
+  g_main_context_iteration (context, TRUE);
+  g_assert_cmpint (data.n_dispatched, ==, N_FDS);
+
+  /* and they are still registered afterwards */
+  g_assert_cmpint (write (fds[0][1], "x", 1), ==, 1);
+  g_main_context_iteration (context, TRUE);
+  g_assert_cmpint (data.n_dispatched, ==, N_FDS + 1);
+
+  for (i = 0; i < N_FDS; i++)
+    {
+      g_source_destroy (sources[i]);
+      g_source_unref (sources[i]);
+      g_io_channel_unref (channels[i]);
+      close (fds[i][0]);
+      close (fds[i][1]);
+    }
+
+  /* let the poll state forget about the fds */
+  g_main_context_iteration (context, FALSE);
+  g_main_context_unref (context);
+}
+
+static gboolean
+on_shared_fd_ready (GIOChannel   *channel,
+                    GIOCondition  condition,
+                    gpointer      user_data)
+{
+  GIOCondition *dispatched = user_data;
+
+  *dispatched |= condition;
+  data.n_dispatched++;
+
+  return TRUE;
+}
+
+/* Two sources watching the same socket, one reading and the other writing */
+static void
+check_shared_fd (GMainContext *context)
+{
+  GIOChannel *channel;
+  GSource *in_source, *out_source;
+  GIOCondition in_dispatched = 0, out_dispatched = 0;
+  gchar byte;
+  gint fds[2];
+
+  g_assert_cmpint (socketpair (AF_UNIX, SOCK_STREAM, 0, fds), ==, 0);
+  channel = g_io_channel_unix_new (fds[0]);
+
+  in_source = g_io_create_watch (channel, G_IO_IN);
+  g_source_set_callback (in_source, (GSourceFunc) on_shared_fd_ready,
+                         &in_dispatched, NULL);
+  g_source_attach (in_source, context);
+
+  out_source = g_io_create_watch (channel, G_IO_OUT);
+  g_source_set_callback (out_source, (GSourceFunc) on_shared_fd_ready,
+                         &out_dispatched, NULL);
+  g_source_attach (out_source, context);
+
+  /* the socket is writable but has nothing to read */
+  data.n_dispatched = 0;
+  g_main_context_iteration (context, TRUE);
+  g_assert_cmpint (data.n_dispatched, ==, 1);
+  g_assert_cmpint (in_dispatched, ==, 0);
+  g_assert_cmpint (out_dispatched, ==, G_IO_OUT);
+
+  /* both sources are dispatched in the same iteration */
+  g_assert_cmpint (write (fds[1], "x", 1), ==, 1);
+  out_dispatched = 0;
+  data.n_dispatched = 0;
+  g_main_context_iteration (context, TRUE);
+  g_assert_cmpint (data.n_dispatched, ==, 2);
+  g_assert_cmpint (in_dispatched, ==, G_IO_IN);
+  g_assert_cmpint (out_dispatched, ==, G_IO_OUT);
+  g_assert_cmpint (read (fds[0], &byte, 1), ==, 1);
+
+  /* and only the reading one once the other is gone */
+  g_source_destroy (out_source);
+  g_source_unref (out_source);
+  g_assert_cmpint (write (fds[1], "x", 1), ==, 1);
+  in_dispatched = 0;
+  data.n_dispatched = 0;
+  g_main_context_iteration (context, TRUE);
+  g_assert_cmpint (data.n_dispatched, ==, 1);
+  g_assert_cmpint (in_dispatched, ==, G_IO_IN);
+
+  g_source_destroy (in_source);
+  g_source_unref (in_source);
+  g_io_channel_unref (channel);
+  close (fds[0]);
+  close (fds[1]);
+
+  g_main_context_iteration (context, FALSE);
+}
+
+static void
+test_shared_fd (void)
+{
+  GMainContext *context;
+
+  check_shared_fd (g_main_context_default ());
+
+  context = g_main_context_new ();
+  g_assert (g_android_attach_context_with_backend (context,
+                                                   G_ANDROID_POLL_BACKEND_CALLBACK));
+  check_shared_fd (context);
+  g_main_context_unref (context);
+}
+
+static gboolean
+on_timeout (gpointer user_data)
+{
+  gint *counter = user_data;
+
+  (*counter)++;
+
+  return FALSE;
+}
+
+static void
+test_timeout (void)
+{
+  gint64 start, elapsed;
+  gint counter = 0;
+
+  start = g_get_monotonic_time ();
+  g_timeout_add (50, on_timeout, &counter);
+  iterate_until (&counter, 1);
+  elapsed = g_get_monotonic_time () - start;
+
+  g_assert_cmpint (elapsed, >=, 50 * 1000);
+}
+
+/* The looper can still have responses queued from the previous poll, for fds
+ * that have been read since: they must not be reported ready again */
+static void
+test_stale_fds (void)
+{
+  GIOChannel *channels[2];
+  guint watch_ids[2];
+  gint fds[2][2], i, counter = 0;
+
+  for (i = 0; i < 2; i++)
+    {
+      g_assert_cmpint (pipe (fds[i]), ==, 0);
+      g_assert_cmpint (fcntl (fds[i][0], F_SETFL, O_NONBLOCK), ==, 0);
+      channels[i] = g_io_channel_unix_new (fds[i][0]);
+      watch_ids[i] = g_io_add_watch (channels[i], G_IO_IN, on_fd_ready, NULL);
+    }
+
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+
+  data.n_dispatched = 0;
+  for (i = 0; i < 2; i++)
+    g_assert_cmpint (write (fds[i][1], "x", 1), ==, 1);
+  g_main_context_iteration (NULL, TRUE);
+  g_assert_cmpint (data.n_dispatched, ==, 2);
+
+  /* on_fd_ready() fails to read an fd reported ready spuriously */
+  g_timeout_add (10, on_timeout, &counter);
+  iterate_until (&counter, 1);
+  g_assert_cmpint (data.n_dispatched, ==, 2);
+
+  for (i = 0; i < 2; i++)
+    {
+      g_source_remove (watch_ids[i]);
+      g_io_channel_unref (channels[i]);
+      close (fds[i][0]);
+      close (fds[i][1]);
+    }
+}
+
+static gint woken_up;
+
+static gpointer
+waker_thread (gpointer user_data)
+{
+  g_usleep (10 * 1000);
+  g_atomic_int_set (&woken_up, 1);
+  g_android_context_wakeup (NULL);
+
+  return NULL;
+}
+
+/* g_android_context_wakeup() interrupts a blocking iteration, through the
+ * looper rather than the GLib wakeup fd */
+static void
+test_wakeup (void)
+{
+  GAndroidLoopStats stats;
+  GThread *thread;
+  guint timeout_id;
+
+  g_android_reset_loop_stats (NULL);
+
+  woken_up = 0;
+  thread = g_thread_new ("waker", waker_thread, NULL);
+  iterate_until (&woken_up, 1);
+  g_thread_join (thread);
+
+  /* The flag is raised before the wakeup, which may still be pending */
+  timeout_id = g_timeout_add_seconds (5, on_timeout_expired, NULL);
+  g_android_get_loop_stats (NULL, &stats);
+  while (stats.n_wakeups_wake == 0)
+    {
+      g_main_context_iteration (NULL, TRUE);
+      g_android_get_loop_stats (NULL, &stats);
+    }
+  g_source_remove (timeout_id);
+
+  g_assert_cmpuint (stats.n_wakeups_wake, ==, 1);
+}
+
+#define SLACK 200
+
+static gboolean
+on_slack_timeout (gpointer user_data)
+{
+  data.n_dispatched++;
+
+  return FALSE;
+}
+
+static void
+add_slack_timeout (GMainContext *context,
+                   guint         interval)
+{
+  GSource *source;
+
+  source = g_timeout_source_new (interval);
+  g_source_set_callback (source, on_slack_timeout, NULL, NULL);
+  g_source_attach (source, context);
+  g_source_unref (source);
+}
+
+/* Sleep until just after a tick of the slack grid */
+static void
+wait_for_slack_tick (void)
+{
+  gint64 slack = SLACK * 1000;
+  gint64 now = g_get_monotonic_time ();
+
+  g_usleep ((now / slack + 1) * slack - now + 1000);
+}
+
+static gpointer
+context_waker_thread (gpointer user_data)
+{
+  g_usleep (50 * 1000);
+  g_android_context_wakeup (user_data);
+
+  return NULL;
+}
+
+/* Timeouts expiring close to each other are dispatched by a single wakeup */
+static void
+test_timer_slack (void)
+{
+  GAndroidTimerSlackStats stats;
+  GMainContext *context;
+  GThread *thread;
+  gint64 now;
+
+  context = g_main_context_new ();
+  g_assert (g_android_attach_context (context));
+  g_assert (g_android_set_timer_slack (context, SLACK));
+
+  /* both deadlines are pushed back to the next tick */
+  wait_for_slack_tick ();
+  add_slack_timeout (context, 5);
+  add_slack_timeout (context, 20);
+
+  data.n_dispatched = 0;
+  g_main_context_iteration (context, TRUE);
+  g_assert_cmpint (data.n_dispatched, ==, 2);
+
+  now = g_get_monotonic_time ();
+  g_assert_cmpint (now % (SLACK * 1000), <, 50 * 1000);
+
+  g_android_get_timer_slack_stats (context, &stats);
+  g_assert_cmpuint (stats.n_timer_polls, ==, 1);
+  g_assert_cmpuint (stats.n_aligned, ==, 1);
+  g_assert_cmpuint (stats.n_timer_wakeups, ==, 1);
+
+  /* a wakeup after the original deadline dispatches the timeout */
+  wait_for_slack_tick ();
+  add_slack_timeout (context, 5);
+  thread = g_thread_new ("waker", context_waker_thread, context);
+
+  data.n_dispatched = 0;
+  while (data.n_dispatched == 0)
+    g_main_context_iteration (context, TRUE);
+  g_thread_join (thread);
+
+  g_android_get_timer_slack_stats (context, &stats);
+  g_assert_cmpuint (stats.n_timer_wakeups, ==, 1);
+  g_assert_cmpuint (stats.n_wakeups_saved, >=, 1);
+
+  g_main_context_unref (context);
+}
+
+/* The statistics account for every poll and what woke it up */
+static void
+test_loop_stats (void)
+{
+  GAndroidLoopStats stats;
+  GMainContext *context;
+  GIOChannel *channel;
+  GSource *source;
+  GThread *thread;
+  guint64 n_latencies;
+  gint fds[2], i, fired = 0;
+
+  context = g_main_context_new ();
+  g_assert (g_android_attach_context (context));
+  g_android_reset_loop_stats (context);
+
+  g_assert_cmpint (pipe (fds), ==, 0);
+  channel = g_io_channel_unix_new (fds[0]);
+  source = g_io_create_watch (channel, G_IO_IN);
+  g_source_set_callback (source, (GSourceFunc) on_fd_ready, NULL, NULL);
+  g_source_attach (source, context);
+  g_source_unref (source);
+
+  data.n_dispatched = 0;
+  g_assert_cmpint (write (fds[1], "x", 1), ==, 1);
+  while (data.n_dispatched < 1)
+    g_main_context_iteration (context, TRUE);
+
+  source = g_timeout_source_new (1);
+  g_source_set_callback (source, on_timeout, &fired, NULL);
+  g_source_attach (source, context);
+  g_source_unref (source);
+  while (fired < 1)
+    g_main_context_iteration (context, TRUE);
+
+  thread = g_thread_new ("waker", context_waker_thread, context);
+  g_main_context_iteration (context, TRUE);
+  g_thread_join (thread);
+
+  g_android_get_loop_stats (context, &stats);
+  g_assert_cmpuint (stats.n_polls, >=, 3);
+  g_assert_cmpuint (stats.n_add_fd, >=, 1);
+  g_assert_cmpuint (stats.n_wakeups_fd, >=, 1);
+  g_assert_cmpuint (stats.n_wakeups_timeout, >=, 1);
+  g_assert_cmpuint (stats.n_wakeups_wake, >=, 1);
+  g_assert_cmpuint (stats.blocked_time, >=, 50 * 1000);
+
+  n_latencies = 0;
+  for (i = 0; i < G_ANDROID_LOOP_STATS_N_BUCKETS; i++)
+    n_latencies += stats.latency[i];
+  g_assert_cmpuint (n_latencies, ==, stats.n_polls);
+
+  g_android_reset_loop_stats (context);
+  g_android_get_loop_stats (context, &stats);
+  g_assert_cmpuint (stats.n_polls, ==, 0);
+
+  g_io_channel_unref (channel);
+  close (fds[0]);
+  close (fds[1]);
+  g_main_context_unref (context);
+}
+
+static void
+test_app_cmd (void)
+{
+  data.n_cmds = 0;
+
+  android_host_app_send_cmd (data.app, APP_CMD_GAINED_FOCUS);
+  iterate_until (&data.n_cmds, 1);
+  g_assert_cmpint (data.last_cmd, ==, APP_CMD_GAINED_FOCUS);
+
+  android_host_app_send_cmd (data.app, APP_CMD_PAUSE);
+  iterate_until (&data.n_cmds, 2);
+  g_assert_cmpint (data.last_cmd, ==, APP_CMD_PAUSE);
+  g_assert_cmpint (data.app->activityState, ==, APP_CMD_PAUSE);
+}
+
+static gboolean
+on_foreground_timeout (gpointer user_data)
+{
+  gint *fired = user_data;
+
+  *fired = 1;
+
+  return FALSE;
+}
+
+static GSource *
+add_background_source (GSource *source)
+{
+  g_source_set_priority (source, G_PRIORITY_DEFAULT_IDLE);
+  g_source_set_callback (source, on_slack_timeout, NULL, NULL);
+  g_source_attach (source, NULL);
+
+  return source;
+}
+
+/* Sources of lower priority than the background one wait for the activity to
+ * be resumed, without keeping the loop busy */
+static void
+test_background (void)
+{
+  GAndroidLoopStats stats;
+  GSource *idle, *timeout;
+  gint64 start;
+  gint fired = 0;
+
+  g_assert (g_android_set_background_priority (NULL, G_PRIORITY_DEFAULT));
+
+  data.n_cmds = 0;
+  android_host_app_send_cmd (data.app, APP_CMD_PAUSE);
+  iterate_until (&data.n_cmds, 1);
+  g_assert (g_android_activity_is_paused ());
+
+  data.n_dispatched = 0;
+  idle = add_background_source (g_idle_source_new ());
+  timeout = add_background_source (g_timeout_source_new (5));
+  start = g_get_monotonic_time ();
+  g_timeout_add (30, on_foreground_timeout, &fired);
+
+  g_android_reset_loop_stats (NULL);
+  iterate_until (&fired, 1);
+  g_assert_cmpint (data.n_dispatched, ==, 0);
+
+  /* a timeout with the background priority fires on time */
+  g_assert_cmpint (g_get_monotonic_time () - start, <, 500000);
+  g_android_get_loop_stats (NULL, &stats);
+  g_assert_cmpuint (stats.n_polls, <, 10);
+
+  android_host_app_send_cmd (data.app, APP_CMD_RESUME);
+  iterate_until (&data.n_dispatched, 2);
+  g_assert (!g_android_activity_is_paused ());
+
+  g_source_destroy (idle);
+  g_source_unref (idle);
+  g_source_destroy (timeout);
+  g_source_unref (timeout);
+
+  g_assert (g_android_set_background_priority (NULL, G_MAXINT));
+}
+
+static gboolean
+on_slow_idle (gpointer user_data)
+{
+  gint *counter = user_data;
+
+  g_usleep (2000);
+
+  return ++(*counter) < 3;
+}
+
+static const GAndroidDispatchProfile *
+find_profile (const GAndroidDispatchProfile *profiles,
+              guint                          n_profiles,
+              const gchar                   *name)
+{
+  guint i;
+
+  for (i = 0; i < n_profiles; i++)
+    if (g_strcmp0 (profiles[i].name, name) == 0)
+      return &profiles[i];
+
+  g_assert_not_reached ();
+
+  return NULL;
+}
+
+/* Dispatches are accounted to the name of the profiled sources, the rest to
+ * the unprofiled ones, slowest first */
+static void
+test_dispatch_profile (void)
+{
+  GAndroidDispatchProfile profiles[G_ANDROID_N_DISPATCH_PROFILES];
+  GAndroidSlowDispatch slowest[G_ANDROID_N_SLOWEST_DISPATCHES];
+  const GAndroidDispatchProfile *profile;
+  GSource *idle, *timeout;
+  gint n_idles = 0, n_unprofiled_idles = 0, fired = 0;
+  guint i, n;
+
+  g_assert (g_android_set_dispatch_profiling (NULL, TRUE));
+  g_android_reset_dispatch_profiles (NULL);
+
+  idle = g_idle_source_new ();
+  g_source_set_name (idle, "SlowIdle");
+  g_source_set_callback (idle, on_slow_idle, &n_idles, NULL);
+  g_android_source_set_profiled (idle, TRUE);
+  g_source_attach (idle, NULL);
+  g_source_unref (idle);
+
+  g_idle_add (on_slow_idle, &n_unprofiled_idles);
+
+  /* unnamed, and profiled again after getting its own callback back */
+  timeout = g_timeout_source_new (1);
+  g_source_set_callback (timeout, on_timeout, &fired, NULL);
+  g_android_source_set_profiled (timeout, TRUE);
+  g_android_source_set_profiled (timeout, FALSE);
+  g_android_source_set_profiled (timeout, TRUE);
+  g_source_attach (timeout, NULL);
+  g_source_unref (timeout);
+
+  iterate_until (&n_idles, 3);
+  iterate_until (&n_unprofiled_idles, 3);
+  iterate_until (&fired, 1);
+
+  /* the last dispatches are accounted by the next prepare */
+  g_main_context_iteration (NULL, FALSE);
+
+  n = g_android_get_dispatch_profiles (NULL, profiles,
+                                       G_N_ELEMENTS (profiles));
+  g_assert_cmpuint (n, ==, 3);
+  for (i = 1; i < n; i++)
+    g_assert_cmpuint (profiles[i - 1].total_time, >=, profiles[i].total_time);
+
+  profile = find_profile (profiles, n, "SlowIdle");
+  g_assert_cmpuint (profile->n_dispatches, ==, 3);
+  g_assert_cmpuint (profile->total_time, >=, 3 * 2000);
+  g_assert_cmpuint (profile->max_time, >=, 2000);
+
+  profile = find_profile (profiles, n, "GTimeoutSource");
+  g_assert_cmpuint (profile->n_dispatches, ==, 1);
+
+  /* found without being set profiled */
+  profile = find_profile (profiles, n, "Unprofiled sources");
+  g_assert_cmpuint (profile->total_time, >=, 3 * 2000);
+  g_assert_cmpuint (profile->max_time, >=, 2000);
+
+  n = g_android_get_slowest_dispatches (NULL, slowest, G_N_ELEMENTS (slowest));
+  g_assert_cmpuint (n, >=, 6);
+  for (i = 1; i < n; i++)
+    g_assert_cmpuint (slowest[i - 1].duration, >=, slowest[i].duration);
+  g_assert_cmpuint (slowest[5].duration, >=, 2000);
+
+  g_android_dump_dispatch_profiles (NULL, 4);
+
+  g_android_reset_dispatch_profiles (NULL);
+  g_assert (g_android_set_dispatch_profiling (NULL, FALSE));
+  g_assert_cmpuint (g_android_get_dispatch_profiles (NULL, profiles, 4), ==, 0);
+  g_assert_cmpuint (g_android_get_slowest_dispatches (NULL, slowest, 4), ==,
+                    0);
+}
+
+#define FRAME_INTERVAL 10000
+#define N_FRAMES 8
+
+typedef struct
+{
+  gint n_frames;
+  gint64 frame_times[N_FRAMES];
+  gint64 presentation_times[N_FRAMES];
+  guint n_skipped[N_FRAMES];
+  gint overrun_frame;
+} FrameData;
+
+static gboolean
+on_frame (gint64    frame_time,
+          gint64    presentation_time,
+          guint     n_skipped,
+          gpointer  user_data)
+{
+  FrameData *frames = user_data;
+  gint i = frames->n_frames++;
+
+  g_assert_cmpint (i, <, N_FRAMES);
+  g_assert_cmpint (g_get_monotonic_time (), >=, frame_time);
+
+  frames->frame_times[i] = frame_time;
+  frames->presentation_times[i] = presentation_time;
+  frames->n_skipped[i] = n_skipped;
+
+  if (i == frames->overrun_frame)
+    g_usleep (FRAME_INTERVAL * 2.5);
+
+  return TRUE;
+}
+
+/* Frames tick on the grid and skip the frames an overrun missed */
+static void
+test_frame_source (void)
+{
+  FrameData frames;
+  GSource *source;
+  gint i, fired = 0;
+
+  memset (&frames, 0, sizeof (frames));
+  frames.overrun_frame = 2;
+
+  source = g_android_frame_source_new (FRAME_INTERVAL);
+  g_source_set_callback (source, (GSourceFunc) on_frame, &frames, NULL);
+  g_source_attach (source, NULL);
+
+  iterate_until (&frames.n_frames, 4);
+
+  for (i = 0; i < 4; i++)
+    {
+      g_assert_cmpint (frames.frame_times[i] % FRAME_INTERVAL, ==, 0);
+      g_assert_cmpint (frames.presentation_times[i], ==,
+                       frames.frame_times[i] + FRAME_INTERVAL);
+
+      if (i > 0)
+        g_assert_cmpint (frames.frame_times[i] - frames.frame_times[i - 1], ==,
+                         (frames.n_skipped[i] + 1) * FRAME_INTERVAL);
+    }
+
+  g_assert_cmpuint (frames.n_skipped[3], >=, 1);
+
+  /* no frame while paused */
+  data.n_cmds = 0;
+  android_host_app_send_cmd (data.app, APP_CMD_PAUSE);
+  iterate_until (&data.n_cmds, 1);
+  i = frames.n_frames;
+  g_timeout_add (5 * FRAME_INTERVAL / 1000, on_foreground_timeout, &fired);
+  iterate_until (&fired, 1);
+  g_assert_cmpint (frames.n_frames, ==, i);
+
+  /* and frames missed meanwhile aren't skipped */
+  android_host_app_send_cmd (data.app, APP_CMD_RESUME);
+  iterate_until (&frames.n_frames, i + 1);
+  g_assert_cmpuint (frames.n_skipped[i], ==, 0);
+
+  g_source_destroy (source);
+  g_source_unref (source);
+}
+
+/* Pending commands are processed one budget at a time */
+static void
+test_glue_budget (void)
+{
+  gint i;
+
+  g_android_set_glue_budget (1, 0);
+
+  data.n_cmds = 0;
+  for (i = 0; i < 3; i++)
+    android_host_app_send_cmd (data.app, APP_CMD_GAINED_FOCUS);
+
+  for (i = 1; i <= 3; i++)
+    {
+      g_main_context_iteration (NULL, FALSE);
+      g_assert_cmpint (data.n_cmds, ==, i);
+    }
+
+  g_android_set_glue_budget (G_ANDROID_GLUE_DEFAULT_MAX_EVENTS,
+                             G_ANDROID_GLUE_DEFAULT_MAX_TIME);
+}
+
+static void
+on_app_cmd (struct android_app *app,
+            gint8               cmd,
+            gpointer            user_data)
+{
+  gint *n_cmds = user_data;
+
+  (*n_cmds)++;
+  data.last_cmd = cmd;
+}
+
+static gboolean
+on_idle (gpointer user_data)
+{
+  gint *counter = user_data;
+
+  (*counter)++;
+
+  return FALSE;
+}
+
+/* Commands go through the app source, ordered by GLib priorities */
+static void
+test_app_source (void)
+{
+  GSource *source;
+  gint n_cmds = 0, n_idles = 0;
+
+  source = g_android_app_source_new (data.app);
+  g_source_set_callback (source, (GSourceFunc) on_app_cmd, &n_cmds, NULL);
+  g_source_set_priority (source, G_PRIORITY_LOW);
+  g_source_attach (source, NULL);
+
+  data.n_cmds = 0;
+  g_idle_add (on_idle, &n_idles);
+  android_host_app_send_cmd (data.app, APP_CMD_LOST_FOCUS);
+
+  /* the idle has a higher priority than the app source */
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_cmpint (n_idles, ==, 1);
+  g_assert_cmpint (n_cmds, ==, 0);
+
+  iterate_until (&n_cmds, 1);
+  g_assert_cmpint (data.last_cmd, ==, APP_CMD_LOST_FOCUS);
+  g_assert_cmpint (data.n_cmds, ==, 0);
+
+  g_source_destroy (source);
+  g_source_unref (source);
+}
+
+/* An app source attached to another context doesn't have the polls of the
+ * default context spin until it is dispatched */
+static void
+test_app_source_other_context (void)
+{
+  GAndroidLoopStats stats;
+  GMainContext *context;
+  GSource *source;
+  gint n_cmds = 0, timed_out = 0;
+  guint timeout_id;
+
+  context = g_main_context_new ();
+  source = g_android_app_source_new (data.app);
+  g_source_set_callback (source, (GSourceFunc) on_app_cmd, &n_cmds, NULL);
+  g_source_attach (source, context);
+
+  data.n_cmds = 0;
+  g_android_reset_loop_stats (NULL);
+  android_host_app_send_cmd (data.app, APP_CMD_LOST_FOCUS);
+  g_timeout_add (50, on_idle, &timed_out);
+  iterate_until (&timed_out, 1);
+
+  g_android_get_loop_stats (NULL, &stats);
+  g_assert_cmpuint (stats.n_polls, <, 10);
+  g_assert_cmpint (n_cmds, ==, 0);
+
+  g_assert (g_main_context_iteration (context, FALSE));
+  g_assert_cmpint (n_cmds, ==, 1);
+  g_assert_cmpint (data.last_cmd, ==, APP_CMD_LOST_FOCUS);
+
+  /* the command pipe is polled again once the source has read from it */
+  android_host_app_send_cmd (data.app, APP_CMD_GAINED_FOCUS);
+  timeout_id = g_timeout_add_seconds (5, on_timeout_expired, NULL);
+  while (n_cmds < 2)
+    {
+      g_main_context_iteration (NULL, FALSE);
+      g_main_context_iteration (context, FALSE);
+    }
+  g_source_remove (timeout_id);
+  g_assert_cmpint (data.last_cmd, ==, APP_CMD_GAINED_FOCUS);
+  g_assert_cmpint (data.n_cmds, ==, 0);
+
+  g_source_destroy (source);
+  g_source_unref (source);
+  g_main_context_unref (context);
+}
+
+static gboolean
+on_input_event (struct android_app *app,
+                AInputEvent        *event,
+                gpointer            user_data)
+{
+  gint *n_events = user_data;
+
+  (*n_events)++;
+  data.last_x = AMotionEvent_getX (event, 0);
+
+  return TRUE;
+}
+
+static void
+test_input_source (void)
+{
+  AInputQueue *queue;
+  GSource *source;
+  gint n_events = 0;
+
+  queue = android_host_input_queue_new ();
+
+  data.n_cmds = 0;
+  android_host_app_set_input_queue (data.app, queue);
+  iterate_until (&data.n_cmds, 1);
+
+  source = g_android_input_source_new (data.app);
+  g_source_set_callback (source, (GSourceFunc) on_input_event, &n_events,
+                         NULL);
+  g_source_attach (source, NULL);
+
+  data.n_input_events = 0;
+  android_host_input_queue_push_motion (queue, 0, AMOTION_EVENT_ACTION_DOWN,
+                                        0, 30.f, 40.f);
+  android_host_input_queue_push_motion (queue, 0, AMOTION_EVENT_ACTION_UP,
+                                        0, 50.f, 60.f);
+  iterate_until (&n_events, 2);
+  g_assert_cmpint (data.last_x, ==, 50.f);
+  g_assert_cmpint (data.n_input_events, ==, 0);
+  g_assert_cmpint (android_host_input_queue_get_n_finished (queue), ==, 2);
+
+  g_source_destroy (source);
+  g_source_unref (source);
+
+  data.n_cmds = 0;
+  android_host_app_set_input_queue (data.app, NULL);
+  iterate_until (&data.n_cmds, 1);
+
+  android_host_input_queue_free (queue);
+}
+
+static void
+on_input_batch (struct android_app  *app,
+                AInputEvent        **events,
+                gboolean            *handled,
+                guint                n_events,
+                gpointer             user_data)
+{
+  gint *n_batches = user_data;
+  guint i;
+
+  g_assert_cmpuint (n_events, ==, 3);
+  g_assert_cmpint (AMotionEvent_getAction (events[0]), ==,
+                   AMOTION_EVENT_ACTION_DOWN);
+  g_assert_cmpint (AMotionEvent_getAction (events[1]), ==,
+                   AMOTION_EVENT_ACTION_MOVE);
+  g_assert_cmpint (AMotionEvent_getX (events[1], 0), ==, 3.f);
+  g_assert_cmpint (AMotionEvent_getAction (events[2]), ==,
+                   AMOTION_EVENT_ACTION_UP);
+
+  for (i = 0; i < n_events; i++)
+    handled[i] = TRUE;
+
+  (*n_batches)++;
+}
+
+/* Queued events are delivered at once, the moves coalesced */
+static void
+test_input_batch_source (void)
+{
+  AInputQueue *queue;
+  GSource *source;
+  gint n_batches = 0;
+
+  queue = android_host_input_queue_new ();
+
+  data.n_cmds = 0;
+  android_host_app_set_input_queue (data.app, queue);
+  iterate_until (&data.n_cmds, 1);
+
+  source =
+    g_android_input_batch_source_new (data.app,
+                                      G_ANDROID_INPUT_BATCH_COALESCE_MOTION);
+  g_source_set_callback (source, (GSourceFunc) on_input_batch, &n_batches,
+                         NULL);
+  g_source_attach (source, NULL);
+
+  android_host_input_queue_push_motion (queue, 0, AMOTION_EVENT_ACTION_DOWN,
+                                        0, 0.f, 0.f);
+  android_host_input_queue_push_motion (queue, 0, AMOTION_EVENT_ACTION_MOVE,
+                                        0, 1.f, 0.f);
+  android_host_input_queue_push_motion (queue, 0, AMOTION_EVENT_ACTION_MOVE,
+                                        0, 2.f, 0.f);
+  android_host_input_queue_push_motion (queue, 0, AMOTION_EVENT_ACTION_MOVE,
+                                        0, 3.f, 0.f);
+  android_host_input_queue_push_motion (queue, 0, AMOTION_EVENT_ACTION_UP,
+                                        0, 3.f, 0.f);
+  iterate_until (&n_batches, 1);
+  g_assert_cmpint (android_host_input_queue_get_n_finished (queue), ==, 5);
+
+  g_source_destroy (source);
+  g_source_unref (source);
+
+  data.n_cmds = 0;
+  android_host_app_set_input_queue (data.app, NULL);
+  iterate_until (&data.n_cmds, 1);
+
+  android_host_input_queue_free (queue);
+}
+
+typedef struct
+{
+  gint n_batches;
+  guint batch_sizes[4];
+} SensorData;
+
+static gboolean
+on_sensor_events (const ASensorEvent *events,
+                  guint               n_events,
+                  gpointer            user_data)
+{
+  SensorData *sensor_data = user_data;
+
+  g_assert_cmpint (events[0].type, ==, ASENSOR_TYPE_ACCELEROMETER);
+  g_assert_cmpint (sensor_data->n_batches, <, 4);
+  sensor_data->batch_sizes[sensor_data->n_batches++] = n_events;
+
+  return TRUE;
+}
+
+static void
+push_sensor_events (ASensorEventQueue *queue,
+                    gint               n_events)
+{
+  ASensorEvent event;
+  gint i;
+
+  memset (&event, 0, sizeof (event));
+  event.version = sizeof (event);
+  event.type = ASENSOR_TYPE_ACCELEROMETER;
+
+  for (i = 0; i < n_events; i++)
+    {
+      event.timestamp = g_get_monotonic_time () * 1000;
+      event.acceleration.x = i + 1;
+      android_host_sensor_event_queue_push (queue, &event);
+    }
+}
+
+static GSource *sensor_sources[2];
+static gint n_sensor_dispatches;
+
+static gboolean
+on_sensor_events_remove_other (const ASensorEvent *events,
+                               guint               n_events,
+                               gpointer            user_data)
+{
+  gint i;
+
+  n_sensor_dispatches++;
+
+  for (i = 0; i < 2; i++)
+    if (sensor_sources[i] && sensor_sources[i] != g_main_current_source ())
+      {
+        g_source_destroy (sensor_sources[i]);
+        g_source_unref (sensor_sources[i]);
+        sensor_sources[i] = NULL;
+      }
+
+  return TRUE;
+}
+
+/* Sensor events are read in bulk and batched over time */
+static void
+test_sensor_source (void)
+{
+  SensorData sensor_data = { 0, };
+  ASensorEventQueue *queue;
+  GSource *source;
+  gint64 start;
+  gint i;
+
+  source = g_android_sensor_source_new (ASensorManager_getInstance (), 8);
+  g_source_set_callback (source, (GSourceFunc) on_sensor_events, &sensor_data,
+                         NULL);
+  g_source_attach (source, NULL);
+  queue = g_android_sensor_source_get_queue (source);
+
+  /* a full buffer is dispatched right away, the rest once read */
+  push_sensor_events (queue, 10);
+  iterate_until (&sensor_data.n_batches, 2);
+  g_assert_cmpuint (sensor_data.batch_sizes[0], ==, 8);
+  g_assert_cmpuint (sensor_data.batch_sizes[1], ==, 2);
+
+  /* events are held for the latency of the source */
+  sensor_data.n_batches = 0;
+  g_android_sensor_source_set_latency (source, 20 * 1000);
+  start = g_get_monotonic_time ();
+  push_sensor_events (queue, 3);
+  g_main_context_iteration (NULL, FALSE);
+  g_assert_cmpint (sensor_data.n_batches, ==, 0);
+  iterate_until (&sensor_data.n_batches, 1);
+  g_assert_cmpuint (sensor_data.batch_sizes[0], ==, 3);
+  g_assert_cmpint (g_get_monotonic_time () - start, >=, 20 * 1000);
+
+  g_source_destroy (source);
+  g_source_unref (source);
+
+  /* two sources are ready, the first one dispatched finalizes the other one
+   * while the looper still has its response queued */
+  n_sensor_dispatches = 0;
+  for (i = 0; i < 2; i++)
+    {
+      sensor_sources[i] =
+        g_android_sensor_source_new (ASensorManager_getInstance (), 8);
+      g_source_set_callback (sensor_sources[i],
+                             (GSourceFunc) on_sensor_events_remove_other,
+                             NULL, NULL);
+      g_source_attach (sensor_sources[i], NULL);
+    }
+  for (i = 0; i < 2; i++)
+    push_sensor_events (g_android_sensor_source_get_queue (sensor_sources[i]),
+                        1);
+
+  iterate_until (&n_sensor_dispatches, 1);
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+  g_assert_cmpint (n_sensor_dispatches, ==, 1);
+
+  for (i = 0; i < 2; i++)
+    if (sensor_sources[i])
+      {
+        g_source_destroy (sensor_sources[i]);
+        g_source_unref (sensor_sources[i]);
+      }
+}
+
+static void
+test_input (void)
+{
+  AInputQueue *queue;
+
+  queue = android_host_input_queue_new ();
+
+  data.n_cmds = 0;
+  android_host_app_set_input_queue (data.app, queue);
+  iterate_until (&data.n_cmds, 1);
+  g_assert (data.app->inputQueue == queue);
+
+  data.n_input_events = 0;
+  android_host_input_queue_push_motion (queue, 0, AMOTION_EVENT_ACTION_DOWN,
+                                        0, 10.f, 20.f);
+  iterate_until (&data.n_input_events, 1);
+  g_assert_cmpint (data.last_x, ==, 10.f);
+  g_assert_cmpint (data.last_y, ==, 20.f);
+  g_assert_cmpint (android_host_input_queue_get_n_finished (queue), ==, 1);
+
+  data.n_cmds = 0;
+  android_host_app_set_input_queue (data.app, NULL);
+  iterate_until (&data.n_cmds, 1);
+
+  android_host_input_queue_free (queue);
+}
+
+#define FLOOD_TIMEOUT 20        /* ms */
+
+typedef struct
+{
+  AInputQueue *queue;
+  gint stop;
+} FloodData;
+
+static gpointer
+flood_thread (gpointer user_data)
+{
+  FloodData *flood = user_data;
+
+  while (!g_atomic_int_get (&flood->stop))
+    {
+      android_host_input_queue_push_motion (flood->queue, 0,
+                                            AMOTION_EVENT_ACTION_MOVE,
+                                            0, 10.f, 20.f);
+      android_host_app_send_cmd (data.app, APP_CMD_GAINED_FOCUS);
+      g_usleep (10);
+    }
+
+  return NULL;
+}
+
+static gboolean
+on_flood_timeout (gpointer user_data)
+{
+  gint64 *fired_time = user_data;
+
+  *fired_time = g_get_monotonic_time ();
+
+  return FALSE;
+}
+
+/* A timeout pending while input events and commands keep on coming is
+ * dispatched on time, with or without a glue budget */
+static void
+test_input_flood (void)
+{
+  static const guint budgets[][2] = {
+    { 0, 0 },
+    { G_ANDROID_GLUE_DEFAULT_MAX_EVENTS, G_ANDROID_GLUE_DEFAULT_MAX_TIME },
+  };
+  FloodData flood;
+  GThread *thread;
+  gint64 start, fired_time;
+  guint i;
+
+  flood.queue = android_host_input_queue_new ();
+
+  data.n_cmds = 0;
+  android_host_app_set_input_queue (data.app, flood.queue);
+  iterate_until (&data.n_cmds, 1);
+
+  for (i = 0; i < G_N_ELEMENTS (budgets); i++)
+    {
+      g_android_set_glue_budget (budgets[i][0], budgets[i][1]);
+
+      data.n_cmds = 0;
+      data.n_input_events = 0;
+      flood.stop = 0;
+      thread = g_thread_new ("flood", flood_thread, &flood);
+
+      /* wait for the flood to be going */
+      iterate_until (&data.n_input_events, 100);
+
+      fired_time = 0;
+      start = g_get_monotonic_time ();
+      g_timeout_add (FLOOD_TIMEOUT, on_flood_timeout, &fired_time);
+      while (fired_time == 0)
+        g_main_context_iteration (NULL, TRUE);
+
+      g_atomic_int_set (&flood.stop, 1);
+      g_thread_join (thread);
+
+      g_assert_cmpint (data.n_cmds, >, 0);
+      g_assert_cmpint (fired_time - start, >=, FLOOD_TIMEOUT * 1000);
+      g_assert_cmpint (fired_time - start, <,
+                       FLOOD_TIMEOUT * 1000 + G_ANDROID_GLUE_DEFAULT_MAX_TIME +
+                       10 * 1000);
+
+      while (g_main_context_iteration (NULL, FALSE))
+        ;
+    }
+
+  g_android_set_glue_budget (G_ANDROID_GLUE_DEFAULT_MAX_EVENTS,
+                             G_ANDROID_GLUE_DEFAULT_MAX_TIME);
+
+  data.n_cmds = 0;
+  android_host_app_set_input_queue (data.app, NULL);
+  iterate_until (&data.n_cmds, 1);
+
+  android_host_input_queue_free (flood.queue);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  data.app = android_host_app_new ();
+  data.app->userData = &data;
+  data.app->onAppCmd = test_handle_cmd;
+  data.app->onInputEvent = test_handle_input;
+
+  g_android_init ();
+
+  g_test_add_func ("/mainloop/fd", test_fd);
+  g_test_add_func ("/mainloop/many-fds", test_many_fds);
+  g_test_add_func ("/mainloop/fd-registry", test_fd_registry);
+  g_test_add_func ("/mainloop/many-fds-callbacks", test_many_fds_callbacks);
+  g_test_add_func ("/mainloop/shared-fd", test_shared_fd);
+  g_test_add_func ("/mainloop/timeout", test_timeout);
+  g_test_add_func ("/mainloop/stale-fds", test_stale_fds);
+  g_test_add_func ("/mainloop/worker-context", test_worker_context);
+  g_test_add_func ("/mainloop/nested-context", test_nested_context);
+  g_test_add_func ("/mainloop/wakeup", test_wakeup);
+  g_test_add_func ("/mainloop/timer-slack", test_timer_slack);
+  g_test_add_func ("/mainloop/loop-stats", test_loop_stats);
+  g_test_add_func ("/mainloop/app-cmd", test_app_cmd);
+  g_test_add_func ("/mainloop/glue-budget", test_glue_budget);
+  g_test_add_func ("/mainloop/background", test_background);
+  g_test_add_func ("/mainloop/dispatch-profile", test_dispatch_profile);
+  g_test_add_func ("/mainloop/frame-source", test_frame_source);
+  g_test_add_func ("/mainloop/input", test_input);
+  g_test_add_func ("/mainloop/input-flood", test_input_flood);
+  g_test_add_func ("/mainloop/app-source", test_app_source);
+  g_test_add_func ("/mainloop/app-source-other-context",
+                   test_app_source_other_context);
+  g_test_add_func ("/mainloop/input-source", test_input_source);
+  g_test_add_func ("/mainloop/input-batch-source", test_input_batch_source);
+  g_test_add_func ("/mainloop/sensor-source", test_sensor_source);
+
+  return g_test_run ();
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copyright (C) 2011 Intel Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Authors:
+ *  Damien Lespiau <damien.lespiau@gmail.com>
+ */
+
+/*
+ * Decodes the trace files written by g_android_log_set_trace_file(), oldest
+ * message first, in a logcat like format.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include "glib-android-trace.h"
+
+typedef struct
+{
+  const GAndroidTraceRecord *record;
+  guint32 age;
+} Entry;
+
+static const gchar *
+get_slot (const GAndroidTraceHeader *header,
+          guint32                    pos)
+{
+  const gchar *slots = (const gchar *) header + G_ANDROID_TRACE_DATA_OFFSET;
+
+  return slots + (pos & (header->n_slots - 1)) * G_ANDROID_TRACE_SLOT_SIZE;
+}
+
+/* Returns FALSE if the slots of the record have been overwritten or are
+ * being written */
+static gboolean
+is_record_complete (const GAndroidTraceHeader *header,
+                    const GAndroidTraceRecord *record)
+{
+  const GAndroidTraceContinuation *continuation;
+  guint i;
+
+  if (record->n_slots == 0 || record->n_slots > G_ANDROID_TRACE_MAX_SLOTS ||
+      header->write_pos - record->sequence >= header->n_slots ||
+      header->write_pos - record->sequence + 1 < record->n_slots)
+    return FALSE;
+
+  for (i = 1; i < record->n_slots; i++)
+    {
+      continuation = (gconstpointer) get_slot (header, record->sequence - 1 + i);
+      if (continuation->sequence != record->sequence + i)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gint
+compare_entries (gconstpointer a,
+                 gconstpointer b)
+{
+  const Entry *entry_a = a, *entry_b = b;
+
+  /* the oldest first */
+  return entry_a->age < entry_b->age ? 1 : entry_a->age > entry_b->age ? -1 : 0;
+}
+
+static void
+print_record (const GAndroidTraceHeader *header,
+              const GAndroidTraceRecord *record)
+{
+  static const gchar priorities[] = "??VDIWEFS";
+  const GAndroidTraceContinuation *continuation;
+  gchar message[G_ANDROID_TRACE_MAX_MESSAGE + 1], date[32];
+  const gchar *domain;
+  gsize length, offset, n;
+  gint64 real_time;
+  time_t seconds;
+  struct tm tm;
+  guint i;
+
+  length = MIN (record->length, G_ANDROID_TRACE_MAX_MESSAGE);
+  offset = MIN (length, sizeof (record->message));
+  memcpy (message, record->message, offset);
+  for (i = 1; i < record->n_slots; i++)
+    {
+      continuation = (gconstpointer) get_slot (header, record->sequence - 1 + i);
+      n = MIN (length - offset, sizeof (continuation->message));
+      memcpy (message + offset, continuation->message, n);
+      offset += n;
+    }
+  message[offset] = '\0';
+
+  if (record->domain == G_ANDROID_TRACE_DOMAIN_NONE)
+    domain = "";
+  else if (record->domain <= MIN (header->n_domains, G_ANDROID_TRACE_N_DOMAINS))
+    domain = header->domains[record->domain - 1];
+  else
+    domain = "?";
+
+  real_time = header->base_real_time +
+              (record->time - header->base_monotonic_time);
+  seconds = real_time / G_USEC_PER_SEC;
+  localtime_r (&seconds, &tm);
+  strftime (date, sizeof (date), "%m-%d %H:%M:%S", &tm);
+
+  g_print ("%s.%06d %5u %c %.*s: %s%s\n",
+           date, (gint) (real_time % G_USEC_PER_SEC), record->tid,
+           record->priority < sizeof (priorities) - 1 ?
+             priorities[record->priority] : '?',
+           G_ANDROID_TRACE_DOMAIN_SIZE, domain, message,
+           record->flags & G_ANDROID_TRACE_FLAG_TRUNCATED ? "[...]" : "");
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  const GAndroidTraceHeader *header;
+  const GAndroidTraceRecord *record;
+  GOptionContext *option_context;
+  GError *error = NULL;
+  GArray *entries;
+  Entry entry;
+  gchar *contents;
+  gsize size;
+  guint i;
+
+  option_context = g_option_context_new ("FILE - decode a glib-android trace");
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free (option_context);
+
+  if (argc != 2)
+    {
+      g_printerr ("Usage: %s FILE\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (!g_file_get_contents (argv[1], &contents, &size, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+  header = (gconstpointer) contents;
+  if (size < G_ANDROID_TRACE_DATA_OFFSET ||
+      memcmp (header->magic, G_ANDROID_TRACE_MAGIC, sizeof (header->magic)) ||
+      header->version != G_ANDROID_TRACE_VERSION ||
+      header->n_slots == 0 || (header->n_slots & (header->n_slots - 1)) ||
+      size < G_ANDROID_TRACE_DATA_OFFSET +
+             (gsize) header->n_slots * G_ANDROID_TRACE_SLOT_SIZE)
+    {
+      g_printerr ("%s is not a glib-android trace\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  entries = g_array_new (FALSE, FALSE, sizeof (Entry));
+  for (i = 0; i < header->n_slots; i++)
+    {
+      record = (gconstpointer) get_slot (header, i);
+      if (record->sequence == 0 ||
+          ((record->sequence - 1) & (header->n_slots - 1)) != i ||
+          !is_record_complete (header, record))
+        continue;
+
+      entry.record = record;
+      entry.age = header->write_pos - record->sequence;
+      g_array_append_val (entries, entry);
+    }
+
+  g_array_sort (entries, compare_entries);
+  for (i = 0; i < entries->len; i++)
+    print_record (header, g_array_index (entries, Entry, i).record);
+
+  g_array_free (entries, TRUE);
+  g_free (contents);
+
+  return EXIT_SUCCESS;
+}